@@ -31,198 +31,4672 @@
  */
 
 #include "MCP7940M.h"
+#include <string.h> /* Needed for memcpy */
 
+static void MCP7940M_DecodeTimeRegisters(MCP7940M *p_mcp7940m, const uint8_t *p_regs);
+static void MCP7940M_EncodeTimeRegisters(const MCP7940M *p_mcp7940m, uint8_t *p_regs);
+static HAL_StatusTypeDef MCP7940M_StopOscillator(MCP7940M *p_mcp7940m);
+static void MCP7940M_GetTimeFields(const MCP7940M *p_mcp7940m, MCP7940M_Time *p_time);
+static void MCP7940M_InitFields(MCP7940M *p_mcp7940m, const MCP7940M_Transport *p_transport, void *p_busContext);
+static void MCP7940M_EncodeAlarm(const MCP7940M *p_mcp7940m, const MCP7940M_Alarm *p_alarm, uint8_t wkday, uint8_t *p_regs);
+static void MCP7940M_TrimAdjusted(int8_t trim, uint8_t control, uint8_t allowCoarse, int32_t errorPpb, int8_t *p_trim, uint8_t *p_control);
+static void MCP7940M_CalibrationReset(MCP7940M_Calibration *p_cal, uint32_t refHz, uint32_t seconds);
+static void MCP7940M_CalibrationWindow(MCP7940M_Calibration *p_cal, uint8_t oscTrim);
+static HAL_StatusTypeDef MCP7940M_PollStep(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task);
+static HAL_StatusTypeDef MCP7940M_ReadTimeBlock(MCP7940M *p_mcp7940m, uint8_t *p_regs);
+static void MCP7940M_ShadowUpdate(MCP7940M *p_mcp7940m, uint8_t reg, const uint8_t *p_data, uint16_t length, uint8_t written);
+static HAL_StatusTypeDef MCP7940M_StartGetTime(MCP7940M *p_mcp7940m, MCP7940M_Callback callback, uint8_t op, uint8_t dma);
+static HAL_StatusTypeDef MCP7940M_StartSetTime(MCP7940M *p_mcp7940m, MCP7940M_Callback callback, uint8_t dma);
+static HAL_StatusTypeDef MCP7940M_AsyncStart(MCP7940M *p_mcp7940m, uint8_t write, uint8_t reg, uint8_t *p_data, uint16_t length);
+static void MCP7940M_AsyncAdvance(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+static void MCP7940M_AsyncFinish(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+static HAL_StatusTypeDef MCP7940M_TxnAppend(MCP7940M_TxnList *p_list, uint8_t write, uint8_t reg, uint8_t length, uint8_t *p_offset);
+static void MCP7940M_TxnCopyReads(const MCP7940M_TxnList *p_list);
+static HAL_StatusTypeDef MCP7940M_StartTxn(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback, uint8_t dma);
+static HAL_StatusTypeDef MCP7940M_TxnStartBurst(MCP7940M *p_mcp7940m);
+static HAL_StatusTypeDef MCP7940M_RingCheck(uint8_t base, uint8_t slotSize, uint8_t slotCount);
+static uint8_t MCP7940M_RingNextTag(uint8_t tag);
+static HAL_StatusTypeDef MCP7940M_EventAnchor(MCP7940M *p_mcp7940m, MCP7940M_EventQueue *p_queue);
+static HAL_StatusTypeDef MCP7940M_SecondCounterSync(MCP7940M *p_mcp7940m);
+static HAL_StatusTypeDef MCP7940M_Transfer(MCP7940M *p_mcp7940m, uint8_t write, uint8_t reg, uint8_t *p_read, const uint8_t *p_write, uint16_t length);
+static void MCP7940M_RetryBackoff(MCP7940M *p_mcp7940m, uint8_t attempt);
+static void MCP7940M_BusPowerUp(MCP7940M *p_mcp7940m);
+static inline void MCP7940M_StatsStatus(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+static void MCP7940M_BusPowerDown(MCP7940M *p_mcp7940m);
+static void MCP7940M_GroupLaunch(MCP7940M_Group *p_group, uint8_t index);
+static void MCP7940M_GroupDeviceDone(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+static void MCP7940M_GroupRetire(MCP7940M_Group *p_group, uint8_t index, HAL_StatusTypeDef status);
+static void MCP7940M_GroupEvaluate(MCP7940M_Group *p_group);
+
+/* Timekeeping bits of RTCSEC..RTCYEAR, without ST, OSCRUN and LP. */
+static const uint8_t MCP7940M_FieldMask[MCP7940M_TIME_REG_COUNT] = {0b01111111, 0b01111111, 0b01111111, 0b00000111,
+                                                                    0b00111111, 0b00011111, 0b11111111};
+
+/* Days per month, February of leap years is handled separately. */
+static const uint8_t MCP7940M_DaysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+/* Days before the first of each month in a non-leap year. */
+static const uint16_t MCP7940M_DaysBeforeMonth[12] = {0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+
+/* Operations run by the non-blocking state machine. */
+enum
+{
+    MCP7940M_ASYNC_NONE = 0,
+    MCP7940M_ASYNC_GET_TIME,
+    MCP7940M_ASYNC_GET_RAW, /* Like GET_TIME but leaves decoding to MCP7940M_DecodeTime */
+    MCP7940M_ASYNC_SET_TIME,
+    MCP7940M_ASYNC_TXN      /* Bursts of txnList, asyncStep is the running burst */
+};
+
+/* Steps of MCP7940M_ASYNC_SET_TIME. */
+enum
+{
+    MCP7940M_SET_STEP_STOP = 0, /* RTCSEC <- 0 */
+    MCP7940M_SET_STEP_OSCRUN,   /* Poll RTCWKDAY until OSCRUN clears */
+    MCP7940M_SET_STEP_BURST     /* RTCSEC..RTCYEAR <- new time */
+};
+
+/* States of the 1 Hz second counter. */
+enum
+{
+    MCP7940M_TICK_STOPPED = 0, /* Edges are ignored */
+    MCP7940M_TICK_ARMED,       /* Edges are counted, tick holds no edge time yet */
+    MCP7940M_TICK_SYNC,        /* The next edge takes over syncTime */
+    MCP7940M_TICK_RUNNING      /* Every edge advances tick */
+};
+
+/*
+ * INITIALISATION
+ */
+
+#ifndef MCP7940M_NO_HAL
+/**
+ * @brief  Initializes the MCP7940M
+ * @param  p_mcp7940m Pointer to a MCP7940M structure that will contain
+ *                  our MCP7940M data.
+ * @param  p_i2cHandle Pointer to our I2C handle
+ * @retval HAL status of the register map read or oscillator start.
+ */
+HAL_StatusTypeDef MCP7940M_Init(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle)
+{
+    return MCP7940M_InitTransport(p_mcp7940m, &MCP7940M_HAL_Transport, p_i2cHandle);
+}
+#endif
+
+/**
+ * @brief  Initializes the MCP7940M on a custom bus transport
+ * @note   RTCSEC..ALM1MTH are read in one burst to load the shadow cache and
+ *         the time fields. A running clock is left alone, so an MCU reset
+ *         costs no time and no write. ST is only set when it is clear, and
+ *         then without touching the seconds.
+ * @param  p_mcp7940m Pointer to a MCP7940M structure that will contain
+ *                  our MCP7940M data.
+ * @param  p_transport Bus access functions, must stay valid.
+ * @param  p_busContext Passed to every transport function.
+ * @retval HAL status of the register map read or oscillator start.
+ */
+HAL_StatusTypeDef MCP7940M_InitTransport(MCP7940M *p_mcp7940m, const MCP7940M_Transport *p_transport, void *p_busContext)
+{
+    HAL_StatusTypeDef status;
+
+    MCP7940M_InitFields(p_mcp7940m, p_transport, p_busContext);
+
+    status = MCP7940M_LoadCache(p_mcp7940m);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_mcp7940m->shadow);
+
+    /* Enable Oscillator, a no-op if it is already running. */
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, MCP7940M_RTCSEC_ST, MCP7940M_RTCSEC_ST);
+}
+
+/**
+ * @brief  Sets up the struct for a transport without any bus access.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_transport Bus transport.
+ * @param  p_busContext Passed to every transport function.
+ */
+static void MCP7940M_InitFields(MCP7940M *p_mcp7940m, const MCP7940M_Transport *p_transport, void *p_busContext)
+{
+    uint8_t i;
+
+    p_mcp7940m->transport = p_transport;
+    p_mcp7940m->busContext = p_busContext;
+    p_mcp7940m->busHz = MCP7940M_DEFAULT_BUS_HZ;
+    p_mcp7940m->timeoutMargin = MCP7940M_TIMEOUT_MARGIN;
+    p_mcp7940m->retries = MCP7940M_DEFAULT_RETRIES;
+    p_mcp7940m->retryBackoff = MCP7940M_DEFAULT_BACKOFF;
+    p_mcp7940m->busRecover = NULL;
+    p_mcp7940m->recoverContext = NULL;
+    p_mcp7940m->busLock = NULL;
+    p_mcp7940m->busUnlock = NULL;
+    p_mcp7940m->busPowerUp = NULL;
+    p_mcp7940m->busPowerDown = NULL;
+    p_mcp7940m->powerContext = NULL;
+
+    p_mcp7940m->seconds = 0;
+    p_mcp7940m->minutes = 0;
+    p_mcp7940m->hours = 0;
+    p_mcp7940m->weekday = MONDAY;
+    p_mcp7940m->date = 1;
+    p_mcp7940m->month = 1;
+    p_mcp7940m->year = 0;
+
+    p_mcp7940m->state = MCP7940M_STATE_READY;
+    p_mcp7940m->callback = NULL;
+    p_mcp7940m->asyncOp = MCP7940M_ASYNC_NONE;
+    p_mcp7940m->asyncDma = 0;
+    p_mcp7940m->txnList = NULL;
+
+    p_mcp7940m->changeValid = 0;
+    for (i = 0; i < MCP7940M_TIME_REG_COUNT; i++)
+    {
+        p_mcp7940m->onChange[i] = NULL;
+    }
+
+    MCP7940M_InvalidateCache(p_mcp7940m);
+#ifdef MCP7940M_ENABLE_STATS
+    MCP7940M_ResetStats(p_mcp7940m);
+#endif
+
+    p_mcp7940m->timerRead = NULL;
+    p_mcp7940m->timerHz = 0;
+    p_mcp7940m->tick.sequence = 0;
+    p_mcp7940m->tickEdges = 0;
+    p_mcp7940m->tickState = MCP7940M_TICK_STOPPED;
+
+    p_mcp7940m->snapshot.sequence = 0;
+    p_mcp7940m->epochMonth = 0;
+}
+
+/**
+ * @brief  Gets the time from the MCP7940M
+ * @note   RTCSEC..RTCYEAR are read in a single burst. Only a burst that
+ *         starts at second 59 can straddle a minute rollover, so only then
+ *         RTCSEC is read again and the burst repeated if it has moved on.
+ *         The struct is left untouched if the read fails.
+ * @param  p_mcp7940m Pointer to a MCP7940M structure that will
+ *                    store our MCP7940M data.
+ * @retval HAL status of the burst read.
+ */
+HAL_StatusTypeDef MCP7940M_GetTime(MCP7940M *p_mcp7940m)
+{
+    uint8_t regs[MCP7940M_TIME_REG_COUNT];
+    HAL_StatusTypeDef status;
+    MCP7940M_STATS_BEGIN(start);
+
+    status = MCP7940M_ReadTimeBlock(p_mcp7940m, regs);
+    if (status == HAL_OK)
+    {
+        MCP7940M_DecodeTimeRegisters(p_mcp7940m, regs);
+    }
+
+    MCP7940M_STATS_END(p_mcp7940m, MCP7940M_STATS_GET_TIME, start);
+    return status;
+}
+
+/**
+ * @brief  Writes the time to the MCP7940M
+ * @note   The oscillator is stopped and OSCRUN is awaited before
+ *         RTCSEC..RTCYEAR are written in a single burst. The burst carries
+ *         the ST bit, so the oscillator restarts with the complete new time
+ *         and no field can roll over while the others are being written.
+ * @param  p_mcp7940m Pointer to a MCP7940M structure that contains
+ *                  the data we ant to write to our MCP7940M.
+ * @retval HAL_OK if success, HAL_TIMEOUT if the oscillator did not stop,
+ *         otherwise the HAL status of the failing transfer.
+ */
+HAL_StatusTypeDef MCP7940M_SetTime(MCP7940M *p_mcp7940m)
+{
+    uint8_t regs[MCP7940M_TIME_REG_COUNT];
+    HAL_StatusTypeDef status;
+    MCP7940M_STATS_BEGIN(start);
+
+    status = MCP7940M_StopOscillator(p_mcp7940m);
+    if (status == HAL_OK)
+    {
+        MCP7940M_EncodeTimeRegisters(p_mcp7940m, regs);
+        status = MCP7940M_WriteRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, regs, MCP7940M_TIME_REG_COUNT);
+    }
+
+    MCP7940M_STATS_END(p_mcp7940m, MCP7940M_STATS_SET_TIME, start);
+    return status;
+}
+
+/*
+ * CHANGE NOTIFICATION
+ */
+
+/**
+ * @brief  Reads the time and updates only the fields that changed.
+ * @note   The burst is compared with the one of the previous call, control
+ *         and status bits ignored. Only changed fields are decoded into the
+ *         struct; the others keep their value, so do not modify the time
+ *         fields between calls without writing them to the chip. Afterwards
+ *         the callback of every changed field runs, seconds first. The first
+ *         call reports MCP7940M_CHANGED_ALL.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_changed Receives the mask of changed fields, (1 << MCP7940M_Field).
+ *                   May be NULL. Unchanged on error.
+ * @retval HAL status of the burst read.
+ */
+HAL_StatusTypeDef MCP7940M_GetTimeChanges(MCP7940M *p_mcp7940m, uint8_t *p_changed)
+{
+    uint8_t regs[MCP7940M_TIME_REG_COUNT];
+    uint8_t changed = 0;
+    uint8_t i;
+    HAL_StatusTypeDef status;
+    MCP7940M_STATS_BEGIN(start);
+
+    status = MCP7940M_ReadTimeBlock(p_mcp7940m, regs);
+    MCP7940M_STATS_END(p_mcp7940m, MCP7940M_STATS_GET_TIME, start);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    for (i = 0; i < MCP7940M_TIME_REG_COUNT; i++)
+    {
+        if (!p_mcp7940m->changeValid || ((regs[i] ^ p_mcp7940m->changeRaw[i]) & MCP7940M_FieldMask[i]))
+        {
+            changed |= 1 << i;
+        }
+        p_mcp7940m->changeRaw[i] = regs[i];
+    }
+    p_mcp7940m->changeValid = 1;
+
+    if (changed & (1 << MCP7940M_FIELD_SECONDS))
+    {
+        p_mcp7940m->seconds = MCP7940M_BCDDecode(regs[0] & 0b01111111);
+    }
+    if (changed & (1 << MCP7940M_FIELD_MINUTES))
+    {
+        p_mcp7940m->minutes = MCP7940M_BCDDecode(regs[1] & 0b01111111);
+    }
+    if (changed & (1 << MCP7940M_FIELD_HOURS))
+    {
+        p_mcp7940m->hours = MCP7940M_DecodeHours(regs[2]);
+        p_mcp7940m->twelveHour = (regs[2] & MCP7940M_RTCHOUR_12_24) ? 1 : 0;
+    }
+    if (changed & (1 << MCP7940M_FIELD_WEEKDAY))
+    {
+        p_mcp7940m->weekday = MCP7940M_DecodeWeekday(regs[3]);
+    }
+    if (changed & (1 << MCP7940M_FIELD_DATE))
+    {
+        p_mcp7940m->date = MCP7940M_BCDDecode(regs[4] & 0b00111111);
+    }
+    if (changed & (1 << MCP7940M_FIELD_MONTH))
+    {
+        p_mcp7940m->month = MCP7940M_BCDDecode(regs[5] & 0b00011111);
+    }
+    if (changed & (1 << MCP7940M_FIELD_YEAR))
+    {
+        p_mcp7940m->year = MCP7940M_BCDDecode(regs[6]);
+    }
+
+    if (p_changed != NULL)
+    {
+        *p_changed = changed;
+    }
+    for (i = 0; i < MCP7940M_TIME_REG_COUNT; i++)
+    {
+        if ((changed & (1 << i)) && p_mcp7940m->onChange[i] != NULL)
+        {
+            p_mcp7940m->onChange[i](p_mcp7940m, changed);
+        }
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Registers the callback run when a field changes, e.g. MCP7940M_FIELD_MINUTES
+ *         for every new minute or MCP7940M_FIELD_DATE for every new day.
+ * @note   Callbacks run from MCP7940M_GetTimeChanges, in the caller's context.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  field Field to watch.
+ * @param  callback Function to call, NULL to remove it.
+ */
+void MCP7940M_SetChangeCallback(MCP7940M *p_mcp7940m, MCP7940M_Field field, MCP7940M_ChangeCallback callback)
+{
+    if ((uint8_t)field < MCP7940M_TIME_REG_COUNT)
+    {
+        p_mcp7940m->onChange[field] = callback;
+    }
+}
+
+/*
+ * SHARED ACCESS
+ */
+
+/**
+ * @brief  Installs lock functions taken around every blocking transfer.
+ * @note   Devices sharing a bus should share the lock. The _IT/_DMA
+ *         operations complete in interrupt context and are not covered.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  lock Acquires the lock, NULL to disable locking.
+ * @param  unlock Releases the lock.
+ * @param  p_context Passed to lock and unlock, e.g. a mutex handle.
+ */
+void MCP7940M_SetBusLock(MCP7940M *p_mcp7940m, MCP7940M_BusLock lock, MCP7940M_BusLock unlock, void *p_context)
+{
+    p_mcp7940m->busLock = lock;
+    p_mcp7940m->busUnlock = unlock;
+    p_mcp7940m->lockContext = p_context;
+}
+
+/**
+ * @brief  Reads the time and publishes it for MCP7940M_ReadSnapshot.
+ * @note   Call from a single owner task or ISR. The time fields of the
+ *         struct belong to that owner; other contexts use the snapshot.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the burst read, the snapshot is unchanged on error.
+ */
+HAL_StatusTypeDef MCP7940M_Refresh(MCP7940M *p_mcp7940m)
+{
+    MCP7940M_Time time;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_GetTime(p_mcp7940m);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    MCP7940M_GetTimeFields(p_mcp7940m, &time);
+    MCP7940M_SnapshotPublish(&p_mcp7940m->snapshot, &time, p_mcp7940m->transport->getTick(p_mcp7940m->busContext));
+    return HAL_OK;
+}
+
+/**
+ * @brief  Copies the time published by the last MCP7940M_Refresh.
+ * @note   Lock-free and without bus access, callable from any task or ISR.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_time Receives the time.
+ * @param  p_tick Receives the transport tick of the read, may be NULL.
+ */
+void MCP7940M_ReadSnapshot(const MCP7940M *p_mcp7940m, MCP7940M_Time *p_time, uint32_t *p_tick)
+{
+    MCP7940M_SnapshotRead(&p_mcp7940m->snapshot, p_time, p_tick);
+}
+
+/*
+ * EPOCH TIME
+ */
+
+/**
+ * @brief  Gets the time from the MCP7940M as Unix time.
+ * @note   One burst read. The date part of the conversion is cached and
+ *         only recomputed when date, month or year change.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure, its time fields are
+ *                    updated as by MCP7940M_GetTime.
+ * @param  p_epoch Receives seconds since 1970-01-01 00:00:00.
+ * @retval HAL status of the burst read, HAL_ERROR if the chip holds a time
+ *         with a field out of range.
+ */
+HAL_StatusTypeDef MCP7940M_GetEpoch(MCP7940M *p_mcp7940m, uint32_t *p_epoch)
+{
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_GetTime(p_mcp7940m);
+    if (status == HAL_OK)
+    {
+        *p_epoch = MCP7940M_FieldsToEpoch(p_mcp7940m);
+        if (*p_epoch == MCP7940M_EPOCH_INVALID)
+        {
+            status = HAL_ERROR;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Sets the MCP7940M from Unix time.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure, its time fields are
+ *                    set to the converted time.
+ * @param  epoch Seconds since 1970-01-01 00:00:00, within 2000..2099.
+ * @retval HAL_ERROR if epoch is outside the range of the chip, otherwise
+ *         the status of MCP7940M_SetTime.
+ */
+HAL_StatusTypeDef MCP7940M_SetEpoch(MCP7940M *p_mcp7940m, uint32_t epoch)
+{
+    MCP7940M_Time time;
+
+    if (epoch < MCP7940M_EPOCH_2000 || epoch >= MCP7940M_EPOCH_2100)
+    {
+        return HAL_ERROR;
+    }
+
+    MCP7940M_EpochToTime(epoch, &time);
+    p_mcp7940m->seconds = time.seconds;
+    p_mcp7940m->minutes = time.minutes;
+    p_mcp7940m->hours = time.hours;
+    p_mcp7940m->weekday = time.weekday;
+    p_mcp7940m->date = time.date;
+    p_mcp7940m->month = time.month;
+    p_mcp7940m->year = time.year;
+    return MCP7940M_SetTime(p_mcp7940m);
+}
+
+/**
+ * @brief  Converts the time fields of the struct to Unix time.
+ * @note   While the date is unchanged this costs one compare and an add.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval Seconds since 1970-01-01 00:00:00, MCP7940M_EPOCH_INVALID if a
+ *         field is out of range.
+ */
+uint32_t MCP7940M_FieldsToEpoch(MCP7940M *p_mcp7940m)
+{
+    MCP7940M_Time time;
+
+    MCP7940M_GetTimeFields(p_mcp7940m, &time);
+    if (!MCP7940M_TimeValid(&time))
+    {
+        return MCP7940M_EPOCH_INVALID;
+    }
+    if (p_mcp7940m->date != p_mcp7940m->epochDate || p_mcp7940m->month != p_mcp7940m->epochMonth ||
+        p_mcp7940m->year != p_mcp7940m->epochYear)
+    {
+        p_mcp7940m->epochDayStart = MCP7940M_EPOCH_2000 +
+                                    MCP7940M_DaysSince2000(p_mcp7940m->date, p_mcp7940m->month, p_mcp7940m->year) * 86400UL;
+        p_mcp7940m->epochDate = p_mcp7940m->date;
+        p_mcp7940m->epochMonth = p_mcp7940m->month;
+        p_mcp7940m->epochYear = p_mcp7940m->year;
+    }
+    return p_mcp7940m->epochDayStart + p_mcp7940m->hours * 3600UL + p_mcp7940m->minutes * 60U + p_mcp7940m->seconds;
+}
+
+/*
+ * NON-BLOCKING GET AND SET TIME
+ */
+
+/**
+ * @brief  Starts an interrupt driven burst read of the time.
+ * @note   The struct fields are updated just before callback is invoked from
+ *         the I2C interrupt. HAL_I2C_MemRxCpltCallback, HAL_I2C_MemTxCpltCallback
+ *         and HAL_I2C_ErrorCallback must be forwarded to the MCP7940M_I2C_*
+ *         functions.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @retval HAL_OK if the transfer was started, HAL_BUSY if an operation is
+ *         already running, otherwise the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_GetTime_IT(MCP7940M *p_mcp7940m, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartGetTime(p_mcp7940m, callback, MCP7940M_ASYNC_GET_TIME, 0);
+}
+
+/**
+ * @brief  Starts an interrupt driven write of the time.
+ * @note   Runs the same stop oscillator / wait for OSCRUN / burst write
+ *         sequence as MCP7940M_SetTime. The time is captured from the struct
+ *         when this function is called.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @retval HAL_OK if the sequence was started, HAL_BUSY if an operation is
+ *         already running, otherwise the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_SetTime_IT(MCP7940M *p_mcp7940m, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartSetTime(p_mcp7940m, callback, 0);
+}
+
+/**
+ * @brief  Starts a DMA burst read of the raw time registers.
+ * @note   The registers land in p_mcp7940m->raw and are not decoded, so the
+ *         completion costs no CPU time beyond the HAL callbacks. Call
+ *         MCP7940M_DecodeTime when the binary fields are needed.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @retval HAL_OK if the transfer was started, HAL_BUSY if an operation is
+ *         already running, otherwise the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_GetTime_DMA(MCP7940M *p_mcp7940m, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartGetTime(p_mcp7940m, callback, MCP7940M_ASYNC_GET_RAW, 1);
+}
+
+/**
+ * @brief  Starts a DMA driven write of the time.
+ * @note   Same sequence as MCP7940M_SetTime_IT with every transfer done by DMA.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @retval HAL_OK if the sequence was started, HAL_BUSY if an operation is
+ *         already running, otherwise the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_SetTime_DMA(MCP7940M *p_mcp7940m, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartSetTime(p_mcp7940m, callback, 1);
+}
+
+/**
+ * @brief  Decodes p_mcp7940m->raw into the time fields of the struct.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ */
+void MCP7940M_DecodeTime(MCP7940M *p_mcp7940m)
+{
+    MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_mcp7940m->raw);
+}
+
+/**
+ * @brief  Reports the end of an asynchronous transfer, called by the transport.
+ * @note   The HAL transport is served by the MCP7940M_I2C_* forwarders below.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  status HAL_OK if the transfer succeeded.
+ */
+void MCP7940M_TransferComplete(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status)
+{
+    if (p_mcp7940m->state == MCP7940M_STATE_BUSY)
+    {
+        MCP7940M_StatsStatus(p_mcp7940m, status);
+        MCP7940M_AsyncAdvance(p_mcp7940m, status);
+    }
+}
+
+#ifndef MCP7940M_NO_HAL
+/**
+ * @brief  Forward HAL_I2C_MemRxCpltCallback here.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_i2cHandle The handle passed to the HAL callback.
+ */
+void MCP7940M_I2C_MemRxCpltCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle)
+{
+    if (p_i2cHandle == p_mcp7940m->busContext)
+    {
+        MCP7940M_TransferComplete(p_mcp7940m, HAL_OK);
+    }
+}
+
+/**
+ * @brief  Forward HAL_I2C_MemTxCpltCallback here.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_i2cHandle The handle passed to the HAL callback.
+ */
+void MCP7940M_I2C_MemTxCpltCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle)
+{
+    if (p_i2cHandle == p_mcp7940m->busContext)
+    {
+        MCP7940M_TransferComplete(p_mcp7940m, HAL_OK);
+    }
+}
+
+/**
+ * @brief  Forward HAL_I2C_ErrorCallback here.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_i2cHandle The handle passed to the HAL callback.
+ */
+void MCP7940M_I2C_ErrorCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle)
+{
+    if (p_i2cHandle == p_mcp7940m->busContext)
+    {
+        MCP7940M_TransferComplete(p_mcp7940m, HAL_ERROR);
+    }
+}
+#endif
+
+/**
+ * @brief  Starts a non-blocking burst read of the time registers.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @param  op MCP7940M_ASYNC_GET_TIME or MCP7940M_ASYNC_GET_RAW.
+ * @param  dma 1 to use DMA, 0 to use interrupts.
+ * @retval HAL_OK if started, HAL_BUSY if an operation is running, otherwise
+ *         the HAL status of the start.
+ */
+static HAL_StatusTypeDef MCP7940M_StartGetTime(MCP7940M *p_mcp7940m, MCP7940M_Callback callback, uint8_t op, uint8_t dma)
+{
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->state == MCP7940M_STATE_BUSY)
+    {
+        return HAL_BUSY;
+    }
+
+    p_mcp7940m->state = MCP7940M_STATE_BUSY;
+    p_mcp7940m->callback = callback;
+    p_mcp7940m->asyncOp = op;
+    p_mcp7940m->asyncDma = dma;
+
+    status = MCP7940M_AsyncStart(p_mcp7940m, 0, MCP7940M_REG_RTCSEC, p_mcp7940m->raw, MCP7940M_TIME_REG_COUNT);
+    if (status != HAL_OK)
+    {
+        p_mcp7940m->asyncOp = MCP7940M_ASYNC_NONE;
+        p_mcp7940m->state = MCP7940M_STATE_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief  Starts the non-blocking stop oscillator / wait / burst write sequence.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  callback Called on completion, may be NULL.
+ * @param  dma 1 to use DMA, 0 to use interrupts.
+ * @retval HAL_OK if started, HAL_BUSY if an operation is running, otherwise
+ *         the HAL status of the start.
+ */
+static HAL_StatusTypeDef MCP7940M_StartSetTime(MCP7940M *p_mcp7940m, MCP7940M_Callback callback, uint8_t dma)
+{
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->state == MCP7940M_STATE_BUSY)
+    {
+        return HAL_BUSY;
+    }
+
+    p_mcp7940m->state = MCP7940M_STATE_BUSY;
+    p_mcp7940m->callback = callback;
+    p_mcp7940m->asyncOp = MCP7940M_ASYNC_SET_TIME;
+    p_mcp7940m->asyncStep = MCP7940M_SET_STEP_STOP;
+    p_mcp7940m->asyncDma = dma;
+    MCP7940M_EncodeTimeRegisters(p_mcp7940m, p_mcp7940m->raw);
+
+    p_mcp7940m->asyncScratch = 0; // Clear the ST bit.
+    status = MCP7940M_AsyncStart(p_mcp7940m, 1, MCP7940M_REG_RTCSEC, &p_mcp7940m->asyncScratch, 1);
+    if (status != HAL_OK)
+    {
+        p_mcp7940m->asyncOp = MCP7940M_ASYNC_NONE;
+        p_mcp7940m->state = MCP7940M_STATE_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief  Starts one interrupt or DMA driven register transfer.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  write 1 to write p_data to the chip, 0 to read into p_data.
+ * @param  reg First register of the transfer.
+ * @param  p_data Buffer that must stay valid until the transfer completes.
+ * @param  length Number of registers.
+ * @retval HAL status of the start.
+ */
+static HAL_StatusTypeDef MCP7940M_AsyncStart(MCP7940M *p_mcp7940m, uint8_t write, uint8_t reg, uint8_t *p_data, uint16_t length)
+{
+    const MCP7940M_Transport *p_transport = p_mcp7940m->transport;
+    HAL_StatusTypeDef status;
+
+    if ((write && p_transport->writeAsync == NULL) || (!write && p_transport->readAsync == NULL))
+    {
+        return HAL_ERROR;
+    }
+
+    /* Powered down again by MCP7940M_AsyncFinish. */
+    MCP7940M_BusPowerUp(p_mcp7940m);
+    MCP7940M_STATS_ADD(p_mcp7940m, transactions, 1);
+    if (write)
+    {
+        MCP7940M_STATS_ADD(p_mcp7940m, bytesWritten, length);
+        status = p_transport->writeAsync(p_mcp7940m->busContext, MCP7940M_I2C_ADDRESS, reg, p_data, length, p_mcp7940m->asyncDma);
+    }
+    else
+    {
+        MCP7940M_STATS_ADD(p_mcp7940m, bytesRead, length);
+        status = p_transport->readAsync(p_mcp7940m->busContext, MCP7940M_I2C_ADDRESS, reg, p_data, length, p_mcp7940m->asyncDma);
+    }
+    if (status != HAL_OK)
+    {
+        MCP7940M_StatsStatus(p_mcp7940m, status);
+        MCP7940M_BusPowerDown(p_mcp7940m);
+    }
+    return status;
+}
+
+/**
+ * @brief  Advances the running operation after a transfer has completed.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  status Status of the transfer that just completed.
+ */
+static void MCP7940M_AsyncAdvance(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status)
+{
+    if (status != HAL_OK)
+    {
+        MCP7940M_AsyncFinish(p_mcp7940m, status);
+        return;
+    }
+
+    switch (p_mcp7940m->asyncOp)
+    {
+    case MCP7940M_ASYNC_GET_TIME:
+        MCP7940M_ShadowUpdate(p_mcp7940m, MCP7940M_REG_RTCSEC, p_mcp7940m->raw, MCP7940M_TIME_REG_COUNT, 0);
+        MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_mcp7940m->raw);
+        MCP7940M_AsyncFinish(p_mcp7940m, HAL_OK);
+        return;
+
+    case MCP7940M_ASYNC_GET_RAW:
+        MCP7940M_ShadowUpdate(p_mcp7940m, MCP7940M_REG_RTCSEC, p_mcp7940m->raw, MCP7940M_TIME_REG_COUNT, 0);
+        MCP7940M_AsyncFinish(p_mcp7940m, HAL_OK);
+        return;
+
+    case MCP7940M_ASYNC_SET_TIME:
+        switch (p_mcp7940m->asyncStep)
+        {
+        case MCP7940M_SET_STEP_STOP:
+            /* Mirror ST = 0 like the blocking write does, so a failure later in the sequence
+               does not leave a cached ST = 1 that keeps the oscillator from being restarted. */
+            MCP7940M_ShadowUpdate(p_mcp7940m, MCP7940M_REG_RTCSEC, &p_mcp7940m->asyncScratch, 1, 1);
+            p_mcp7940m->asyncStep = MCP7940M_SET_STEP_OSCRUN;
+            p_mcp7940m->asyncStart = p_mcp7940m->transport->getTick(p_mcp7940m->busContext);
+            status = MCP7940M_AsyncStart(p_mcp7940m, 0, MCP7940M_REG_RTCWKDAY, &p_mcp7940m->asyncScratch, 1);
+            break;
+
+        case MCP7940M_SET_STEP_OSCRUN:
+            if (p_mcp7940m->asyncScratch & MCP7940M_RTCWKDAY_OSCRUN)
+            {
+                if ((p_mcp7940m->transport->getTick(p_mcp7940m->busContext) - p_mcp7940m->asyncStart) >= MCP7940M_OSCRUN_TIMEOUT)
+                {
+                    status = HAL_TIMEOUT;
+                    break;
+                }
+                status = MCP7940M_AsyncStart(p_mcp7940m, 0, MCP7940M_REG_RTCWKDAY, &p_mcp7940m->asyncScratch, 1);
+                break;
+            }
+            p_mcp7940m->asyncStep = MCP7940M_SET_STEP_BURST;
+            status = MCP7940M_AsyncStart(p_mcp7940m, 1, MCP7940M_REG_RTCSEC, p_mcp7940m->raw, MCP7940M_TIME_REG_COUNT);
+            break;
+
+        default: /* MCP7940M_SET_STEP_BURST */
+            MCP7940M_ShadowUpdate(p_mcp7940m, MCP7940M_REG_RTCSEC, p_mcp7940m->raw, MCP7940M_TIME_REG_COUNT, 1);
+            MCP7940M_AsyncFinish(p_mcp7940m, HAL_OK);
+            return;
+        }
+        if (status != HAL_OK)
+        {
+            MCP7940M_AsyncFinish(p_mcp7940m, status);
+        }
+        return;
+
+    case MCP7940M_ASYNC_TXN:
+    {
+        const MCP7940M_TxnBurst *p_burst = &p_mcp7940m->txnList->bursts[p_mcp7940m->asyncStep];
+
+        MCP7940M_ShadowUpdate(p_mcp7940m, p_burst->reg, &p_mcp7940m->txnList->buffer[p_burst->offset], p_burst->length, p_burst->write);
+        if (++p_mcp7940m->asyncStep == p_mcp7940m->txnList->burstCount)
+        {
+            MCP7940M_TxnCopyReads(p_mcp7940m->txnList);
+            MCP7940M_AsyncFinish(p_mcp7940m, HAL_OK);
+            return;
+        }
+        status = MCP7940M_TxnStartBurst(p_mcp7940m);
+        if (status != HAL_OK)
+        {
+            MCP7940M_AsyncFinish(p_mcp7940m, status);
+        }
+        return;
+    }
+
+    default:
+        return;
+    }
+}
+
+/**
+ * @brief  Ends the running operation and notifies the callback.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  status Final status of the operation.
+ */
+static void MCP7940M_AsyncFinish(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status)
+{
+    MCP7940M_Callback callback = p_mcp7940m->callback;
+
+    MCP7940M_BusPowerDown(p_mcp7940m);
+    p_mcp7940m->asyncOp = MCP7940M_ASYNC_NONE;
+    p_mcp7940m->state = (status == HAL_OK) ? MCP7940M_STATE_READY : MCP7940M_STATE_ERROR;
+
+    if (callback != NULL)
+    {
+        callback(p_mcp7940m, status);
+    }
+}
+
+/*
+ * TRANSACTION LISTS
+ */
+
+/**
+ * @brief  Empties a transaction list.
+ * @param  p_list Pointer to the list.
+ */
+void MCP7940M_TxnInit(MCP7940M_TxnList *p_list)
+{
+    p_list->burstCount = 0;
+    p_list->readCount = 0;
+    p_list->used = 0;
+}
+
+/**
+ * @brief  Queues a read of consecutive registers.
+ * @note   p_data is filled once the list has executed successfully, it must
+ *         stay valid until then.
+ * @param  p_list Pointer to the list.
+ * @param  reg First register.
+ * @param  p_data Destination of length bytes.
+ * @param  length Number of registers.
+ * @retval HAL_OK, HAL_ERROR if the list is full.
+ */
+HAL_StatusTypeDef MCP7940M_TxnQueueRead(MCP7940M_TxnList *p_list, uint8_t reg, uint8_t *p_data, uint8_t length)
+{
+    MCP7940M_TxnRead *p_read;
+    uint8_t offset;
+
+    if (p_list->readCount == MCP7940M_TXN_MAX_READS)
+    {
+        return HAL_ERROR;
+    }
+    if (MCP7940M_TxnAppend(p_list, 0, reg, length, &offset) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    p_read = &p_list->reads[p_list->readCount++];
+    p_read->p_data = p_data;
+    p_read->offset = offset;
+    p_read->length = length;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Queues a write of consecutive registers.
+ * @note   The data is copied into the list, p_data may be reused right away.
+ * @param  p_list Pointer to the list.
+ * @param  reg First register.
+ * @param  p_data Register values.
+ * @param  length Number of registers.
+ * @retval HAL_OK, HAL_ERROR if the list is full.
+ */
+HAL_StatusTypeDef MCP7940M_TxnQueueWrite(MCP7940M_TxnList *p_list, uint8_t reg, const uint8_t *p_data, uint8_t length)
+{
+    uint8_t offset;
+
+    if (MCP7940M_TxnAppend(p_list, 1, reg, length, &offset) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    memcpy(&p_list->buffer[offset], p_data, length);
+    return HAL_OK;
+}
+
+/**
+ * @brief  Queues a write of a single register.
+ * @param  p_list Pointer to the list.
+ * @param  reg Register to write.
+ * @param  data Register value.
+ * @retval HAL_OK, HAL_ERROR if the list is full.
+ */
+HAL_StatusTypeDef MCP7940M_TxnQueueWriteRegister(MCP7940M_TxnList *p_list, uint8_t reg, uint8_t data)
+{
+    return MCP7940M_TxnQueueWrite(p_list, reg, &data, 1);
+}
+
+/**
+ * @brief  Runs the bursts of a list one after the other.
+ * @note   Stops at the first failing burst, queued reads are only filled when
+ *         every burst succeeded. The list is left intact and can be run again.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_list Pointer to the list.
+ * @retval HAL status of the first failing burst, HAL_OK otherwise.
+ */
+HAL_StatusTypeDef MCP7940M_TxnExecute(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list)
+{
+    const MCP7940M_TxnBurst *p_burst;
+    HAL_StatusTypeDef status;
+    uint8_t i;
+
+    for (i = 0; i < p_list->burstCount; i++)
+    {
+        p_burst = &p_list->bursts[i];
+        if (p_burst->write)
+        {
+            status = MCP7940M_WriteRegisters(p_mcp7940m, p_burst->reg, &p_list->buffer[p_burst->offset], p_burst->length);
+        }
+        else
+        {
+            status = MCP7940M_ReadRegisters(p_mcp7940m, p_burst->reg, &p_list->buffer[p_burst->offset], p_burst->length);
+        }
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+    }
+
+    MCP7940M_TxnCopyReads(p_list);
+    return HAL_OK;
+}
+
+/**
+ * @brief  Runs a list in interrupt mode, each burst started from the completion of the previous one.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_list Pointer to the list, must stay valid until the callback.
+ * @param  callback Called once after the last burst or the first failure, may be NULL.
+ * @retval HAL_OK if started, HAL_BUSY if an operation is running, otherwise
+ *         the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_TxnExecute_IT(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartTxn(p_mcp7940m, p_list, callback, 0);
+}
+
+/**
+ * @brief  Runs a list in DMA mode, each burst started from the completion of the previous one.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_list Pointer to the list, must stay valid until the callback.
+ * @param  callback Called once after the last burst or the first failure, may be NULL.
+ * @retval HAL_OK if started, HAL_BUSY if an operation is running, otherwise
+ *         the HAL status of the start.
+ */
+HAL_StatusTypeDef MCP7940M_TxnExecute_DMA(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback)
+{
+    return MCP7940M_StartTxn(p_mcp7940m, p_list, callback, 1);
+}
+
+/**
+ * @brief  Reserves buffer space for a transfer, continuing the last burst when possible.
+ * @note   Only the last burst is extended so the queued order is kept. A read
+ *         may skip up to MCP7940M_TXN_READ_GAP registers, which are read and
+ *         discarded.
+ * @param  p_list Pointer to the list.
+ * @param  write 1 for a write, 0 for a read.
+ * @param  reg First register.
+ * @param  length Number of registers.
+ * @param  p_offset Receives the buffer position of the data.
+ * @retval HAL_OK, HAL_ERROR if the list is full or length is 0.
+ */
+static HAL_StatusTypeDef MCP7940M_TxnAppend(MCP7940M_TxnList *p_list, uint8_t write, uint8_t reg, uint8_t length, uint8_t *p_offset)
+{
+    MCP7940M_TxnBurst *p_burst;
+    uint16_t end;
+    uint16_t gap;
+
+    if (length == 0)
+    {
+        return HAL_ERROR;
+    }
+
+    if (p_list->burstCount > 0)
+    {
+        /* The last burst always ends at the end of the used buffer. */
+        p_burst = &p_list->bursts[p_list->burstCount - 1];
+        end = (uint16_t)p_burst->reg + p_burst->length;
+        gap = (uint16_t)(reg - end);
+        if (p_burst->write == write && reg >= end && gap <= (write ? 0 : MCP7940M_TXN_READ_GAP))
+        {
+            if ((uint16_t)p_list->used + gap + length > MCP7940M_TXN_BUFFER_SIZE)
+            {
+                return HAL_ERROR;
+            }
+            *p_offset = (uint8_t)(p_list->used + gap);
+            p_burst->length += (uint8_t)(gap + length);
+            p_list->used += (uint8_t)(gap + length);
+            return HAL_OK;
+        }
+    }
+
+    if (p_list->burstCount == MCP7940M_TXN_MAX_BURSTS || (uint16_t)p_list->used + length > MCP7940M_TXN_BUFFER_SIZE)
+    {
+        return HAL_ERROR;
+    }
+    p_burst = &p_list->bursts[p_list->burstCount++];
+    p_burst->write = write;
+    p_burst->reg = reg;
+    p_burst->length = length;
+    p_burst->offset = p_list->used;
+    *p_offset = p_list->used;
+    p_list->used += length;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Copies the read data of an executed list to the caller buffers.
+ * @param  p_list Pointer to the list.
+ */
+static void MCP7940M_TxnCopyReads(const MCP7940M_TxnList *p_list)
+{
+    const MCP7940M_TxnRead *p_read;
+    uint8_t i;
+
+    for (i = 0; i < p_list->readCount; i++)
+    {
+        p_read = &p_list->reads[i];
+        memcpy(p_read->p_data, &p_list->buffer[p_read->offset], p_read->length);
+    }
+}
+
+/**
+ * @brief  Starts the first burst of a non-blocking list execution.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_list Pointer to the list.
+ * @param  callback Called on completion, may be NULL.
+ * @param  dma 1 to use DMA, 0 to use interrupts.
+ * @retval HAL_OK if started, HAL_BUSY if an operation is running, otherwise
+ *         the HAL status of the start.
+ */
+static HAL_StatusTypeDef MCP7940M_StartTxn(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback, uint8_t dma)
+{
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->state == MCP7940M_STATE_BUSY)
+    {
+        return HAL_BUSY;
+    }
+    if (p_list->burstCount == 0)
+    {
+        return HAL_ERROR;
+    }
+
+    p_mcp7940m->state = MCP7940M_STATE_BUSY;
+    p_mcp7940m->callback = callback;
+    p_mcp7940m->asyncOp = MCP7940M_ASYNC_TXN;
+    p_mcp7940m->asyncStep = 0;
+    p_mcp7940m->asyncDma = dma;
+    p_mcp7940m->txnList = p_list;
+
+    status = MCP7940M_TxnStartBurst(p_mcp7940m);
+    if (status != HAL_OK)
+    {
+        p_mcp7940m->asyncOp = MCP7940M_ASYNC_NONE;
+        p_mcp7940m->state = MCP7940M_STATE_ERROR;
+    }
+    return status;
+}
+
+/**
+ * @brief  Starts burst asyncStep of the running list.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the start.
+ */
+static HAL_StatusTypeDef MCP7940M_TxnStartBurst(MCP7940M *p_mcp7940m)
+{
+    MCP7940M_TxnList *p_list = p_mcp7940m->txnList;
+    const MCP7940M_TxnBurst *p_burst = &p_list->bursts[p_mcp7940m->asyncStep];
+
+    return MCP7940M_AsyncStart(p_mcp7940m, p_burst->write, p_burst->reg, &p_list->buffer[p_burst->offset], p_burst->length);
+}
+
+/*
+ * MULTI-DEVICE GROUP
+ */
+
+/**
+ * @brief  Sets up a group of initialized devices.
+ * @note   Every device needs its own bus (busContext). The MCP7940M has the
+ *         fixed address 0x6F, so two on one bus only work behind an I2C mux,
+ *         and the HAL completion callbacks could not tell them apart.
+ * @param  p_group Group state, owned by the caller.
+ * @param  pp_devices Array of count devices.
+ * @param  count Number of devices, 1..MCP7940M_GROUP_MAX.
+ * @param  tolerance Seconds a device may deviate from the median.
+ * @retval HAL_OK, HAL_ERROR if count is out of range or two devices share a bus.
+ */
+HAL_StatusTypeDef MCP7940M_GroupInit(MCP7940M_Group *p_group, MCP7940M **pp_devices, uint8_t count, uint32_t tolerance)
+{
+    uint8_t i;
+    uint8_t j;
+
+    if (count == 0 || count > MCP7940M_GROUP_MAX)
+    {
+        return HAL_ERROR;
+    }
+    for (i = 0; i < count; i++)
+    {
+        for (j = i + 1; j < count; j++)
+        {
+            if (pp_devices[j]->busContext == pp_devices[i]->busContext)
+            {
+                return HAL_ERROR;
+            }
+        }
+    }
+
+    p_group->count = count;
+    p_group->tolerance = tolerance;
+    p_group->pending = 0;
+    p_group->errorMask = 0;
+    p_group->faultMask = 0;
+    for (i = 0; i < count; i++)
+    {
+        p_group->devices[i] = pp_devices[i];
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Starts reading every device of the group.
+ * @note   While the sample runs the group takes over the callbackContext of
+ *         its devices and restores each one when that device's read is done.
+ *         When all are done the results are compared and callback is invoked.
+ * @param  p_group Pointer to the group.
+ * @param  dma 1 to read with MCP7940M_GetTime_DMA, 0 with MCP7940M_GetTime_IT.
+ * @param  callback Called on completion, may be NULL.
+ * @retval HAL_OK if started, HAL_BUSY if the previous sample is still running.
+ */
+HAL_StatusTypeDef MCP7940M_GroupStart(MCP7940M_Group *p_group, uint8_t dma, MCP7940M_GroupCallback callback)
+{
+    uint8_t i;
+
+    if (p_group->pending != 0)
+    {
+        return HAL_BUSY;
+    }
+
+    p_group->dma = dma;
+    p_group->callback = callback;
+    p_group->errorMask = 0;
+    p_group->faultMask = 0;
+    for (i = 0; i < p_group->count; i++)
+    {
+        p_group->savedContext[i] = p_group->devices[i]->callbackContext;
+        p_group->devices[i]->callbackContext = p_group;
+    }
+
+    p_group->pending = p_group->count;
+    for (i = 0; i < p_group->count; i++)
+    {
+        MCP7940M_GroupLaunch(p_group, i);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Checks whether a sample is still running.
+ * @param  p_group Pointer to the group.
+ * @retval 1 while devices are being read, 0 once the results are valid.
+ */
+uint8_t MCP7940M_GroupBusy(const MCP7940M_Group *p_group)
+{
+    return p_group->pending != 0;
+}
+
+/**
+ * @brief  Starts reading a device, or retires it if the read cannot start.
+ * @param  p_group Pointer to the group.
+ * @param  index Device to start.
+ */
+static void MCP7940M_GroupLaunch(MCP7940M_Group *p_group, uint8_t index)
+{
+    MCP7940M *p_device = p_group->devices[index];
+    HAL_StatusTypeDef status;
+
+    if (p_group->dma)
+    {
+        status = MCP7940M_GetTime_DMA(p_device, MCP7940M_GroupDeviceDone);
+    }
+    else
+    {
+        status = MCP7940M_GetTime_IT(p_device, MCP7940M_GroupDeviceDone);
+    }
+    if (status != HAL_OK)
+    {
+        MCP7940M_GroupRetire(p_group, index, status);
+    }
+}
+
+/**
+ * @brief  Completion callback of the group's device reads.
+ * @param  p_mcp7940m The device that finished.
+ * @param  status Status of its read.
+ */
+static void MCP7940M_GroupDeviceDone(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status)
+{
+    MCP7940M_Group *p_group = (MCP7940M_Group *)p_mcp7940m->callbackContext;
+    uint8_t index;
+
+    for (index = 0; index < p_group->count && p_group->devices[index] != p_mcp7940m; index++)
+    {
+    }
+    if (index == p_group->count)
+    {
+        return;
+    }
+    MCP7940M_GroupRetire(p_group, index, status);
+}
+
+/**
+ * @brief  Records the result of one device and completes the sample after the last.
+ * @param  p_group Pointer to the group.
+ * @param  index Device that finished.
+ * @param  status Status of its read.
+ */
+static void MCP7940M_GroupRetire(MCP7940M_Group *p_group, uint8_t index, HAL_StatusTypeDef status)
+{
+    MCP7940M_Time time;
+    MCP7940M *p_device = p_group->devices[index];
+    uint8_t invalid = 0;
+    uint8_t remaining;
+
+    p_device->callbackContext = p_group->savedContext[index];
+    p_group->epoch[index] = MCP7940M_EPOCH_INVALID;
+    if (status == HAL_OK)
+    {
+        if (p_group->dma)
+        {
+            MCP7940M_DecodeTime(p_device);
+        }
+        /* A faulty clock can return any register value, check before converting. */
+        MCP7940M_GetTimeFields(p_device, &time);
+        if (MCP7940M_TimeValid(&time))
+        {
+            p_group->epoch[index] = MCP7940M_FieldsToEpoch(p_device);
+        }
+        else
+        {
+            invalid = 1;
+        }
+    }
+
+    {
+        MCP7940M_CRITICAL_ENTER();
+        if (status != HAL_OK || invalid)
+        {
+            p_group->errorMask |= 1UL << index;
+        }
+        if (invalid)
+        {
+            p_group->faultMask |= 1UL << index;
+        }
+        remaining = --p_group->pending;
+        MCP7940M_CRITICAL_EXIT();
+    }
+
+    if (remaining == 0)
+    {
+        MCP7940M_GroupEvaluate(p_group);
+        if (p_group->callback != NULL)
+        {
+            p_group->callback(p_group);
+        }
+    }
+}
+
+/**
+ * @brief  Compares the devices read against their median.
+ * @param  p_group Pointer to the group.
+ */
+static void MCP7940M_GroupEvaluate(MCP7940M_Group *p_group)
+{
+    uint32_t sorted[MCP7940M_GROUP_MAX];
+    uint32_t value;
+    uint32_t deviation;
+    uint8_t n = 0;
+    uint8_t i;
+    uint8_t j;
+
+    for (i = 0; i < p_group->count; i++)
+    {
+        if (p_group->errorMask & (1UL << i))
+        {
+            continue;
+        }
+        value = p_group->epoch[i];
+        for (j = n; j > 0 && sorted[j - 1] > value; j--)
+        {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = value;
+        n++;
+    }
+
+    if (n == 0)
+    {
+        p_group->median = 0;
+        p_group->spread = 0;
+        return;
+    }
+    p_group->median = sorted[(n - 1) / 2];
+    p_group->spread = sorted[n - 1] - sorted[0];
+
+    for (i = 0; i < p_group->count; i++)
+    {
+        if (p_group->errorMask & (1UL << i))
+        {
+            continue;
+        }
+        value = p_group->epoch[i];
+        deviation = (value > p_group->median) ? value - p_group->median : p_group->median - value;
+        if (deviation > p_group->tolerance)
+        {
+            p_group->faultMask |= 1UL << i;
+        }
+    }
+}
+
+/*
+ * ALARMS
+ */
+
+/* First register and CONTROL enable bit of each alarm bank. */
+static const uint8_t MCP7940M_AlarmBase[2] = {MCP7940M_REG_ALM0SEC, MCP7940M_REG_ALM1SEC};
+static const uint8_t MCP7940M_AlarmEnable[2] = {MCP7940M_CONTROL_ALM0EN, MCP7940M_CONTROL_ALM1EN};
+
+/**
+ * @brief  Programs an alarm bank and enables the alarm.
+ * @note   The bank is written as one burst, which also clears ALMxIF. The
+ *         MFP only signals alarms while SQWEN is clear, so this does not
+ *         combine with MCP7940M_StartSecondCounter.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  alarm MCP7940M_ALARM_0 or MCP7940M_ALARM_1.
+ * @param  p_alarm Alarm time and match mask. Fields not covered by the mask
+ *                 are written but ignored by the chip.
+ * @retval HAL status of the failing transfer, HAL_OK if all succeeded.
+ */
+HAL_StatusTypeDef MCP7940M_SetAlarm(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, const MCP7940M_Alarm *p_alarm)
+{
+    uint8_t regs[MCP7940M_ALARM_REG_COUNT];
+    uint8_t wkday = 0;
+    HAL_StatusTypeDef status;
+
+    /* ALMPOL shares ALM0WKDAY with the rest of bank 0, keep its current value. */
+    if (alarm == MCP7940M_ALARM_0)
+    {
+        status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_ALM0WKDAY, &wkday, 1);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        wkday &= MCP7940M_ALMWKDAY_ALMPOL;
+    }
+
+    MCP7940M_EncodeAlarm(p_mcp7940m, p_alarm, wkday, regs);
+    status = MCP7940M_WriteRegisters(p_mcp7940m, MCP7940M_AlarmBase[alarm], regs, MCP7940M_ALARM_REG_COUNT);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    return MCP7940M_EnableAlarm(p_mcp7940m, alarm, 1);
+}
+
+/**
+ * @brief  Encodes an alarm into a raw ALMxSEC..ALMxMTH block with ALMxIF cleared.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure, for the hour format.
+ * @param  p_alarm Alarm time and match mask.
+ * @param  wkday ALMPOL bit to keep, 0 for bank 1.
+ * @param  p_regs Receives MCP7940M_ALARM_REG_COUNT register bytes.
+ */
+static void MCP7940M_EncodeAlarm(const MCP7940M *p_mcp7940m, const MCP7940M_Alarm *p_alarm, uint8_t wkday, uint8_t *p_regs)
+{
+    p_regs[0] = binaryToBCD(p_alarm->seconds);
+    p_regs[1] = binaryToBCD(p_alarm->minutes);
+    p_regs[2] = MCP7940M_EncodeHours(p_alarm->hours, p_mcp7940m->twelveHour); // Same format as RTCHOUR.
+    p_regs[3] = wkday | ((uint8_t)p_alarm->match << 4) | MCP7940M_EncodeWeekday(p_alarm->weekday); // ALMxIF cleared.
+    p_regs[4] = binaryToBCD(p_alarm->date);
+    p_regs[5] = binaryToBCD(p_alarm->month);
+}
+
+/**
+ * @brief  Enables or disables an alarm in CONTROL.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  alarm MCP7940M_ALARM_0 or MCP7940M_ALARM_1.
+ * @param  enable 1 to enable, 0 to disable.
+ * @retval HAL status of the CONTROL read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_EnableAlarm(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, uint8_t enable)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_AlarmEnable[alarm],
+                                   enable ? MCP7940M_AlarmEnable[alarm] : 0);
+}
+
+/**
+ * @brief  Selects the MFP level signalling an alarm, for both alarms.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  activeHigh 1 for MFP high on alarm, 0 for MFP low on alarm.
+ * @retval HAL status of the ALM0WKDAY read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_SetAlarmPolarity(MCP7940M *p_mcp7940m, uint8_t activeHigh)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_ALM0WKDAY, MCP7940M_ALMWKDAY_ALMPOL,
+                                   activeHigh ? MCP7940M_ALMWKDAY_ALMPOL : 0);
+}
+
+/**
+ * @brief  Reads the interrupt flag of an alarm from the chip.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  alarm MCP7940M_ALARM_0 or MCP7940M_ALARM_1.
+ * @param  p_flag Receives 1 if the alarm has matched, 0 otherwise.
+ * @retval HAL status of the read.
+ */
+HAL_StatusTypeDef MCP7940M_GetAlarmFlag(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, uint8_t *p_flag)
+{
+    uint8_t wkday;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_AlarmBase[alarm] + 3, &wkday);
+    if (status == HAL_OK)
+    {
+        *p_flag = (wkday & MCP7940M_ALMWKDAY_ALMIF) ? 1 : 0;
+    }
+    return status;
+}
+
+/**
+ * @brief  Clears the interrupt flag of an alarm, releasing MFP.
+ * @note   ALMxIF is set by the chip, so the register is always written even
+ *         if the cached value already shows the flag clear.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  alarm MCP7940M_ALARM_0 or MCP7940M_ALARM_1.
+ * @retval HAL status of the transfers.
+ */
+HAL_StatusTypeDef MCP7940M_ClearAlarmFlag(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm)
+{
+    uint8_t reg = MCP7940M_AlarmBase[alarm] + 3;
+    uint8_t wkday;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, reg, &wkday, 1);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    return MCP7940M_WriteRegister(p_mcp7940m, reg, wkday & ~MCP7940M_ALMWKDAY_ALMIF);
+}
+
+/*
+ * CONTROL AND STATUS BITS
+ */
+
+/**
+ * @brief  Selects 12 or 24 hour format for RTCHOUR and both alarm banks.
+ * @note   The struct fields and MCP7940M_Alarm stay 00..23 in both formats,
+ *         the driver converts on every access. RTCHOUR is read fresh and
+ *         rewritten in the new format, avoid calling it at the full hour.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  twelveHour 1 for 12 hour format with AM/PM, 0 for 24 hour format.
+ * @retval HAL status of the failing transfer, HAL_OK if all succeeded.
+ */
+HAL_StatusTypeDef MCP7940M_SetHourFormat(MCP7940M *p_mcp7940m, uint8_t twelveHour)
+{
+    static const uint8_t regs[3] = {MCP7940M_REG_RTCHOUR, MCP7940M_REG_ALM0HOUR, MCP7940M_REG_ALM1HOUR};
+    uint8_t hours;
+    uint8_t i;
+    HAL_StatusTypeDef status;
+
+    twelveHour = twelveHour ? 1 : 0;
+    for (i = 0; i < 3; i++)
+    {
+        status = MCP7940M_CacheRead(p_mcp7940m, regs[i], &hours, i > 0); // The alarm hours do not count.
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        if (((hours & MCP7940M_RTCHOUR_12_24) ? 1 : 0) == twelveHour)
+        {
+            continue;
+        }
+        status = MCP7940M_WriteRegister(p_mcp7940m, regs[i], MCP7940M_EncodeHours(MCP7940M_DecodeHours(hours), twelveHour));
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        if (i == 0)
+        {
+            p_mcp7940m->twelveHour = twelveHour; // Track RTCHOUR even if an alarm bank fails.
+        }
+    }
+    p_mcp7940m->twelveHour = twelveHour;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Reads the OSCRUN status bit.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_running Receives 1 while the oscillator is running.
+ * @retval HAL status of the RTCWKDAY read.
+ */
+HAL_StatusTypeDef MCP7940M_GetOscillatorRunning(MCP7940M *p_mcp7940m, uint8_t *p_running)
+{
+    uint8_t wkday;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_RTCWKDAY, &wkday, 0);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    *p_running = (wkday & MCP7940M_RTCWKDAY_OSCRUN) ? 1 : 0;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Reads the LP bit, set by the chip while the current year is a leap year.
+ * @note   Served from the shadow cache if known, LP only changes at new year.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_leap Receives 1 in a leap year.
+ * @retval HAL status of the RTCMTH read.
+ */
+HAL_StatusTypeDef MCP7940M_GetLeapYear(MCP7940M *p_mcp7940m, uint8_t *p_leap)
+{
+    uint8_t month;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_RTCMTH, &month, 1);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    *p_leap = (month & MCP7940M_RTCMTH_LP) ? 1 : 0;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Reads CONTROL, test the result against the MCP7940M_CONTROL_ bits.
+ * @note   Served from the shadow cache if known, CONTROL only changes when written.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_control Receives the register value.
+ * @retval HAL status of the CONTROL read.
+ */
+HAL_StatusTypeDef MCP7940M_GetControl(MCP7940M *p_mcp7940m, uint8_t *p_control)
+{
+    return MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, p_control, 1);
+}
+
+/**
+ * @brief  Sets the MFP level used while SQWEN, ALM0EN and ALM1EN are clear.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  high 1 to drive MFP high, 0 to drive it low.
+ * @retval HAL status of the CONTROL read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_SetOutputLevel(MCP7940M *p_mcp7940m, uint8_t high)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_OUT, high ? MCP7940M_CONTROL_OUT : 0);
+}
+
+/**
+ * @brief  Enables or disables the square wave on MFP.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  enable 1 to output the square wave.
+ * @param  frequency One of the MCP7940M_SQWFS_ values, kept when disabling.
+ * @retval HAL status of the CONTROL read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_SetSquareWave(MCP7940M *p_mcp7940m, uint8_t enable, uint8_t frequency)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN | MCP7940M_CONTROL_SQWFS,
+                                   (enable ? MCP7940M_CONTROL_SQWEN : 0) | (frequency & MCP7940M_CONTROL_SQWFS));
+}
+
+/**
+ * @brief  Selects an external 32.768 kHz clock on X1 instead of the crystal.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  enable 1 for the external clock input, 0 for the crystal.
+ * @retval HAL status of the CONTROL read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_SetExternalOscillator(MCP7940M *p_mcp7940m, uint8_t enable)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_EXTOSC, enable ? MCP7940M_CONTROL_EXTOSC : 0);
+}
+
+/*
+ * CALIBRATION
+ */
+
+/**
+ * @brief  Programs OSCTRIM.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  trim Steps of two clock cycles per minute (about 1.017 ppm),
+ *              positive to add cycles for a slow crystal, negative to remove
+ *              them for a fast one. Limited to -127..127. In coarse trim
+ *              mode every step is MCP7940M_TRIM_COARSE_RATIO times larger.
+ * @retval HAL status of the write.
+ */
+HAL_StatusTypeDef MCP7940M_SetTrim(MCP7940M *p_mcp7940m, int8_t trim)
+{
+    uint8_t osctrim;
+
+    if (trim < -127)
+    {
+        trim = -127;
+    }
+    osctrim = (trim >= 0) ? (MCP7940M_OSCTRIM_SIGN | (uint8_t)trim) : (uint8_t)-trim;
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_OSCTRIM, osctrim);
+}
+
+/**
+ * @brief  Gets the programmed OSCTRIM value, from the shadow cache if known.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_trim Receives the signed trim, see MCP7940M_SetTrim.
+ * @retval HAL status of the read.
+ */
+HAL_StatusTypeDef MCP7940M_GetTrim(MCP7940M *p_mcp7940m, int8_t *p_trim)
+{
+    uint8_t osctrim;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_OSCTRIM, &osctrim, 1);
+    if (status == HAL_OK)
+    {
+        *p_trim = (int8_t)(osctrim & MCP7940M_OSCTRIM_TRIMVAL);
+        if (!(osctrim & MCP7940M_OSCTRIM_SIGN))
+        {
+            *p_trim = -*p_trim;
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Corrects the programmed trim by a measured frequency error.
+ * @note   The error must have been measured with the current trim active,
+ *         so repeated calls converge on the crystal's drift over time. The
+ *         trim is scaled by the mode in CRSTRIM. Coarse mode is selected
+ *         when it leaves a smaller error than the limited fine trim, i.e.
+ *         beyond about +-4 000 ppm, but not while the second counter runs,
+ *         since coarse mode changes the square wave to 64 Hz.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  errorPpb Remaining error in parts per billion, positive if the
+ *                  clock runs fast.
+ * @retval HAL status of the transfers.
+ */
+HAL_StatusTypeDef MCP7940M_AdjustTrim(MCP7940M *p_mcp7940m, int32_t errorPpb)
+{
+    int8_t trim;
+    int8_t adjusted;
+    uint8_t control;
+    uint8_t adjustedControl;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_GetTrim(p_mcp7940m, &trim);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, &control, 1);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    MCP7940M_TrimAdjusted(trim, control, p_mcp7940m->tickState == MCP7940M_TICK_STOPPED, errorPpb, &adjusted, &adjustedControl);
+    if (adjusted == trim && adjustedControl == control)
+    {
+        return HAL_OK;
+    }
+
+    /* Coarse mode is only ever active with the coarse value, so no write in
+       between applies a fine trim 7680 times over. */
+    if (!(adjustedControl & MCP7940M_CONTROL_CRSTRIM) && (control & MCP7940M_CONTROL_CRSTRIM))
+    {
+        status = MCP7940M_SetCoarseTrim(p_mcp7940m, 0);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+    }
+    status = MCP7940M_SetTrim(p_mcp7940m, adjusted);
+    if (status == HAL_OK && (adjustedControl & MCP7940M_CONTROL_CRSTRIM) && !(control & MCP7940M_CONTROL_CRSTRIM))
+    {
+        status = MCP7940M_SetCoarseTrim(p_mcp7940m, 1);
+    }
+    return status;
+}
+
+/**
+ * @brief  Computes the trim and mode that remove a measured error.
+ * @param  trim Trim active during the measurement.
+ * @param  control CONTROL during the measurement, for CRSTRIM.
+ * @param  allowCoarse 1 if coarse mode may be selected.
+ * @param  errorPpb Remaining error in parts per billion, positive if fast.
+ * @param  p_trim Receives the new trim, limited to -127..127.
+ * @param  p_control Receives CONTROL with the new CRSTRIM.
+ */
+static void MCP7940M_TrimAdjusted(int8_t trim, uint8_t control, uint8_t allowCoarse, int32_t errorPpb, int8_t *p_trim, uint8_t *p_control)
+{
+    int64_t total;
+    int64_t fine;
+    int64_t coarse;
+    int64_t fineError;
+    int64_t coarseError;
+
+    /* Correction in fine steps, one step is 10^9 / 983040 ppb, rounded to the nearest step. */
+    total = (control & MCP7940M_CONTROL_CRSTRIM) ? (int64_t)trim * MCP7940M_TRIM_COARSE_RATIO : trim;
+    total -= ((int64_t)errorPpb * (int64_t)MCP7940M_TRIM_STEP_SCALE + (errorPpb >= 0 ? 500000000LL : -500000000LL)) / 1000000000LL;
+
+    fine = (total > 127) ? 127 : ((total < -127) ? -127 : total);
+    *p_trim = (int8_t)fine;
+    *p_control = control & (uint8_t)~MCP7940M_CONTROL_CRSTRIM;
+    if (fine == total || !allowCoarse)
+    {
+        return;
+    }
+
+    coarse = (total + (total >= 0 ? MCP7940M_TRIM_COARSE_RATIO / 2 : -MCP7940M_TRIM_COARSE_RATIO / 2)) / MCP7940M_TRIM_COARSE_RATIO;
+    coarse = (coarse > 127) ? 127 : ((coarse < -127) ? -127 : coarse);
+    coarseError = total - coarse * MCP7940M_TRIM_COARSE_RATIO;
+    fineError = total - fine;
+    if ((coarseError < 0 ? -coarseError : coarseError) < (fineError < 0 ? -fineError : fineError))
+    {
+        *p_trim = (int8_t)coarse;
+        *p_control |= MCP7940M_CONTROL_CRSTRIM;
+    }
+}
+
+/**
+ * @brief  Selects coarse trim mode, which applies the trim 128 times a second.
+ * @note   While coarse mode is on, the square wave on MFP runs at 64 Hz
+ *         whatever SQWFS selects.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  enable 1 for coarse trim, 0 for normal trim.
+ * @retval HAL status of the CONTROL read-modify-write.
+ */
+HAL_StatusTypeDef MCP7940M_SetCoarseTrim(MCP7940M *p_mcp7940m, uint8_t enable)
+{
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_CRSTRIM,
+                                   enable ? MCP7940M_CONTROL_CRSTRIM : 0);
+}
+
+/**
+ * @brief  Gets the trim mode, from the shadow cache if known.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_enabled Receives 1 in coarse trim mode, 0 in normal trim mode.
+ * @retval HAL status of the read.
+ */
+HAL_StatusTypeDef MCP7940M_GetCoarseTrim(MCP7940M *p_mcp7940m, uint8_t *p_enabled)
+{
+    uint8_t control;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, &control, 1);
+    if (status == HAL_OK)
+    {
+        *p_enabled = (control & MCP7940M_CONTROL_CRSTRIM) ? 1 : 0;
+    }
+    return status;
+}
+
+/**
+ * @brief  Starts a calibration measurement.
+ * @note   Enables the 1 Hz square wave on MFP and clears CRSTRIM, which would
+ *         turn it into 64 Hz; the trim value is kept and measured as a
+ *         normal trim. Capture each MFP edge with a free-running reference timer (HSE derived, ideally input capture)
+ *         and pass it to MCP7940M_CalibrationEdge. If a PPS signal is
+ *         available, capture it with the same timer and pass it to
+ *         MCP7940M_CalibrationPpsEdge to remove the timer's own error.
+ *         A non-zero trim corrects the clock once a minute, so a window that
+ *         is not whole minutes would count a trim correction more or less.
+ *         The window is then rounded up to a multiple of MCP7940M_TRIM_PERIOD.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_cal Calibration state, owned by the caller.
+ * @param  refHz Nominal frequency of the reference timer.
+ * @param  seconds Length of the measurement window, see p_cal->seconds for
+ *         the length used.
+ * @retval HAL status of the OSCTRIM read and the CONTROL write.
+ */
+HAL_StatusTypeDef MCP7940M_CalibrationStart(MCP7940M *p_mcp7940m, MCP7940M_Calibration *p_cal, uint32_t refHz, uint32_t seconds)
+{
+    HAL_StatusTypeDef status;
+    uint8_t oscTrim;
+
+    MCP7940M_CalibrationReset(p_cal, refHz, seconds);
+    status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_OSCTRIM, &oscTrim, 1);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    MCP7940M_CalibrationWindow(p_cal, oscTrim);
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN | MCP7940M_CONTROL_CRSTRIM | MCP7940M_CONTROL_SQWFS,
+                                   MCP7940M_CONTROL_SQWEN | MCP7940M_SQWFS_1HZ);
+}
+
+/**
+ * @brief  Clears the edge counters of a calibration.
+ * @param  p_cal Calibration state.
+ * @param  refHz Nominal frequency of the reference timer.
+ * @param  seconds Length of the measurement window.
+ */
+static void MCP7940M_CalibrationReset(MCP7940M_Calibration *p_cal, uint32_t refHz, uint32_t seconds)
+{
+    p_cal->refHz = refHz;
+    p_cal->seconds = seconds;
+    p_cal->rtcCount = 0;
+    p_cal->rtcTicks = 0;
+    p_cal->ppsCount = 0;
+    p_cal->ppsTicks = 0;
+}
+
+/**
+ * @brief  Rounds the window up to whole trim periods if a trim is active.
+ * @note   CRSTRIM is clear during the measurement, so a non-zero trim is
+ *         applied once every MCP7940M_TRIM_PERIOD seconds.
+ * @param  p_cal Calibration state.
+ * @param  oscTrim OSCTRIM register during the measurement.
+ */
+static void MCP7940M_CalibrationWindow(MCP7940M_Calibration *p_cal, uint8_t oscTrim)
+{
+    if ((oscTrim & MCP7940M_OSCTRIM_TRIMVAL) != 0)
+    {
+        p_cal->seconds = (p_cal->seconds + MCP7940M_TRIM_PERIOD - 1) / MCP7940M_TRIM_PERIOD * MCP7940M_TRIM_PERIOD;
+    }
+}
+
+/**
+ * @brief  Records an MFP edge, call from the capture or EXTI interrupt.
+ * @param  p_cal Calibration state.
+ * @param  refTicks Reference timer value at the edge.
+ */
+void MCP7940M_CalibrationEdge(MCP7940M_Calibration *p_cal, uint32_t refTicks)
+{
+    if (p_cal->rtcCount > p_cal->seconds)
+    {
+        return;
+    }
+    if (p_cal->rtcCount > 0)
+    {
+        p_cal->rtcTicks += refTicks - p_cal->rtcLast;
+    }
+    p_cal->rtcLast = refTicks;
+    p_cal->rtcCount++;
+}
+
+/**
+ * @brief  Records a PPS edge, call from the capture or EXTI interrupt.
+ * @param  p_cal Calibration state.
+ * @param  refTicks Reference timer value at the edge.
+ */
+void MCP7940M_CalibrationPpsEdge(MCP7940M_Calibration *p_cal, uint32_t refTicks)
+{
+    if (p_cal->ppsCount > p_cal->seconds)
+    {
+        return;
+    }
+    if (p_cal->ppsCount > 0)
+    {
+        p_cal->ppsTicks += refTicks - p_cal->ppsLast;
+    }
+    p_cal->ppsLast = refTicks;
+    p_cal->ppsCount++;
+}
+
+/**
+ * @brief  Checks whether the measurement window is complete.
+ * @param  p_cal Calibration state.
+ * @retval 1 once the MFP edges (and the PPS edges, if any) cover the window.
+ */
+uint8_t MCP7940M_CalibrationDone(const MCP7940M_Calibration *p_cal)
+{
+    if (p_cal->rtcCount <= p_cal->seconds)
+    {
+        return 0;
+    }
+    return (p_cal->ppsCount == 0 || p_cal->ppsCount > p_cal->seconds) ? 1 : 0;
+}
+
+/**
+ * @brief  Computes the frequency error of the RTC from a finished measurement.
+ * @param  p_cal Calibration state.
+ * @param  p_errorPpb Receives the error in parts per billion, positive if
+ *                    the RTC runs fast.
+ * @retval HAL_OK if success, HAL_BUSY if the window is not complete,
+ *         HAL_ERROR if no reference ticks were measured.
+ */
+HAL_StatusTypeDef MCP7940M_CalibrationGetError(const MCP7940M_Calibration *p_cal, int32_t *p_errorPpb)
+{
+    double refPerSecond;
+    double rtcSecond;
+
+    if (!MCP7940M_CalibrationDone(p_cal))
+    {
+        return HAL_BUSY;
+    }
+    if (p_cal->rtcTicks == 0)
+    {
+        return HAL_ERROR;
+    }
+
+    /* Measured length of one RTC second and of one true second, in reference ticks. */
+    rtcSecond = (double)p_cal->rtcTicks / p_cal->seconds;
+    refPerSecond = (p_cal->ppsCount > 0) ? (double)p_cal->ppsTicks / p_cal->seconds : (double)p_cal->refHz;
+
+    *p_errorPpb = (int32_t)((refPerSecond - rtcSecond) * 1e9 / rtcSecond);
+    return HAL_OK;
+}
+
+/**
+ * @brief  Applies a finished measurement to OSCTRIM.
+ * @note   The correction is relative to the trim active during the
+ *         measurement, so calibration can be repeated to track aging.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_cal Calibration state.
+ * @retval HAL_BUSY if the window is not complete, otherwise the status of
+ *         the error computation or the OSCTRIM update.
+ */
+HAL_StatusTypeDef MCP7940M_CalibrationApply(MCP7940M *p_mcp7940m, MCP7940M_Calibration *p_cal)
+{
+    int32_t errorPpb;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CalibrationGetError(p_cal, &errorPpb);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    return MCP7940M_AdjustTrim(p_mcp7940m, errorPpb);
+}
+
+/*
+ * DRIFT MONITOR
+ */
+
+/**
+ * @brief  Prepares a drift monitor.
+ * @param  p_drift Drift state, owned by the caller.
+ * @param  boundMs Largest RTC error in ms tolerated before a resync.
+ * @param  minInterval Shortest resync interval in seconds.
+ * @param  maxInterval Longest resync interval in seconds, also used while the
+ *                     drift is too small to predict a crossing.
+ */
+void MCP7940M_DriftInit(MCP7940M_Drift *p_drift, uint32_t boundMs, uint32_t minInterval, uint32_t maxInterval)
+{
+    p_drift->boundMs = boundMs;
+    p_drift->minInterval = minInterval;
+    p_drift->maxInterval = (maxInterval < minInterval) ? minInterval : maxInterval;
+    MCP7940M_DriftReset(p_drift);
+}
+
+/**
+ * @brief  Forgets all samples, e.g. after the trim or the crystal changed.
+ * @param  p_drift Drift state.
+ */
+void MCP7940M_DriftReset(MCP7940M_Drift *p_drift)
+{
+    p_drift->origin = 0;
+    p_drift->count = 0;
+    p_drift->meanX = 0;
+    p_drift->meanY = 0;
+    p_drift->sxx = 0;
+    p_drift->sxy = 0;
+    p_drift->correction = 0;
+    p_drift->lastOffset = 0;
+}
+
+/**
+ * @brief  Adds a (reference time, RTC offset) pair to the fit.
+ * @param  p_drift Drift state.
+ * @param  refEpoch Reference time of the sample as Unix time.
+ * @param  offsetMs RTC time minus reference time in ms.
+ */
+void MCP7940M_DriftAddSample(MCP7940M_Drift *p_drift, uint32_t refEpoch, int32_t offsetMs)
+{
+    double x;
+    double y;
+    double dx;
+
+    if (p_drift->count == 0)
+    {
+        p_drift->origin = refEpoch;
+    }
+
+    /* Welford's update, no growing sums to overflow or cancel. */
+    x = (double)(int32_t)(refEpoch - p_drift->origin);
+    y = (double)offsetMs + p_drift->correction;
+    p_drift->count++;
+    dx = x - p_drift->meanX;
+    p_drift->meanX += dx / p_drift->count;
+    p_drift->meanY += (y - p_drift->meanY) / p_drift->count;
+    p_drift->sxx += dx * (x - p_drift->meanX);
+    p_drift->sxy += dx * (y - p_drift->meanY);
+    p_drift->lastOffset = offsetMs;
+}
+
+/**
+ * @brief  Reads the RTC and adds its offset from a reference time to the fit.
+ * @note   With the second counter running the offset has the resolution of
+ *         its timer, otherwise whole RTC seconds, which averages out over many
+ *         samples. Call right after the reference time was obtained.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_drift Drift state.
+ * @param  refEpoch Reference time as Unix time, e.g. from NTP or GNSS.
+ * @param  refMillis Milliseconds of the reference time, 0..999.
+ * @retval HAL status of the time read.
+ */
+HAL_StatusTypeDef MCP7940M_DriftMeasure(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift, uint32_t refEpoch, uint16_t refMillis)
+{
+    MCP7940M_Time time;
+    uint32_t rtcEpoch;
+    uint32_t rtcMillis = 0;
+    uint32_t subseconds;
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->tickState == MCP7940M_TICK_RUNNING)
+    {
+        MCP7940M_Now(p_mcp7940m, &time, &subseconds);
+        rtcEpoch = MCP7940M_TimeToEpoch(&time);
+        rtcMillis = (uint32_t)((uint64_t)subseconds * 1000U / p_mcp7940m->timerHz);
+        if (rtcEpoch == MCP7940M_EPOCH_INVALID)
+        {
+            return HAL_ERROR;
+        }
+    }
+    else
+    {
+        status = MCP7940M_GetEpoch(p_mcp7940m, &rtcEpoch);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        rtcMillis = 500; // Middle of the RTC second.
+    }
+
+    MCP7940M_DriftAddSample(p_drift, refEpoch, (int32_t)(rtcEpoch - refEpoch) * 1000 + (int32_t)rtcMillis - (int32_t)refMillis);
+    return HAL_OK;
+}
+
+/**
+ * @brief  Returns the fitted frequency error.
+ * @param  p_drift Drift state.
+ * @param  p_errorPpb Receives the error in parts per billion, positive if
+ *                    the RTC runs fast, as expected by MCP7940M_AdjustTrim.
+ * @retval HAL_OK if success, HAL_BUSY until two samples at different times
+ *         were added.
+ */
+HAL_StatusTypeDef MCP7940M_DriftGetPpb(const MCP7940M_Drift *p_drift, int32_t *p_errorPpb)
+{
+    if (p_drift->count < 2 || p_drift->sxx <= 0)
+    {
+        return HAL_BUSY;
+    }
+    *p_errorPpb = (int32_t)(p_drift->sxy / p_drift->sxx * 1e6); // ms per s to ppb.
+    return HAL_OK;
+}
+
+/**
+ * @brief  Predicts the RTC offset at a reference time.
+ * @param  p_drift Drift state.
+ * @param  refEpoch Reference time as Unix time.
+ * @retval Predicted RTC time minus reference time in ms, the last measured
+ *         offset while the drift is not known yet.
+ */
+int32_t MCP7940M_DriftPredict(const MCP7940M_Drift *p_drift, uint32_t refEpoch)
+{
+    double x;
+
+    if (p_drift->count < 2 || p_drift->sxx <= 0)
+    {
+        return p_drift->lastOffset;
+    }
+    x = (double)(int32_t)(refEpoch - p_drift->origin);
+    return (int32_t)(p_drift->meanY + p_drift->sxy / p_drift->sxx * (x - p_drift->meanX)) - p_drift->correction;
+}
+
+/**
+ * @brief  Schedules the next resync.
+ * @param  p_drift Drift state.
+ * @param  refEpoch Current reference time as Unix time.
+ * @retval Reference time at which the predicted error reaches boundMs,
+ *         limited to minInterval..maxInterval from now. refEpoch itself if
+ *         the bound is already exceeded, refEpoch + minInterval while the
+ *         drift is not known yet.
+ */
+uint32_t MCP7940M_DriftNextSync(const MCP7940M_Drift *p_drift, uint32_t refEpoch)
+{
+    double slope;
+    double offset;
+    double seconds;
+
+    if (p_drift->count < 2 || p_drift->sxx <= 0)
+    {
+        return refEpoch + p_drift->minInterval;
+    }
+
+    offset = MCP7940M_DriftPredict(p_drift, refEpoch);
+    if (offset >= (double)p_drift->boundMs || offset <= -(double)p_drift->boundMs)
+    {
+        return refEpoch;
+    }
+
+    slope = p_drift->sxy / p_drift->sxx;
+    if (slope > 0)
+    {
+        seconds = ((double)p_drift->boundMs - offset) / slope;
+    }
+    else if (slope < 0)
+    {
+        seconds = (-(double)p_drift->boundMs - offset) / slope;
+    }
+    else
+    {
+        seconds = p_drift->maxInterval;
+    }
+
+    if (seconds < p_drift->minInterval)
+    {
+        seconds = p_drift->minInterval;
+    }
+    else if (seconds > p_drift->maxInterval)
+    {
+        seconds = p_drift->maxInterval;
+    }
+    return refEpoch + (uint32_t)seconds;
+}
+
+/**
+ * @brief  Sets the RTC to the reference time and keeps the fit going.
+ * @note   The predicted offset at refEpoch is counted as removed, so later
+ *         samples continue the same line. Call on a whole reference second.
+ *         A running second counter is resynced to the new time.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_drift Drift state.
+ * @param  refEpoch Reference time as Unix time.
+ * @retval HAL status of MCP7940M_SetEpoch or MCP7940M_ResyncSecondCounter.
+ */
+HAL_StatusTypeDef MCP7940M_DriftResync(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift, uint32_t refEpoch)
+{
+    int32_t offset = MCP7940M_DriftPredict(p_drift, refEpoch);
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_SetEpoch(p_mcp7940m, refEpoch);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    if (p_drift->count > 0)
+    {
+        p_drift->correction += offset;
+    }
+    p_drift->lastOffset = 0;
+    if (p_mcp7940m->tickState != MCP7940M_TICK_STOPPED)
+    {
+        return MCP7940M_ResyncSecondCounter(p_mcp7940m);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Feeds the fitted drift to OSCTRIM and starts a new fit.
+ * @note   The new trim changes the drift, so the samples taken with the old
+ *         one are discarded.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_drift Drift state.
+ * @retval HAL_BUSY until the drift is known, otherwise the status of
+ *         MCP7940M_AdjustTrim.
+ */
+HAL_StatusTypeDef MCP7940M_DriftApplyTrim(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift)
+{
+    int32_t errorPpb;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_DriftGetPpb(p_drift, &errorPpb);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    status = MCP7940M_AdjustTrim(p_mcp7940m, errorPpb);
+    if (status == HAL_OK)
+    {
+        MCP7940M_DriftReset(p_drift);
+    }
+    return status;
+}
+
+/*
+ * COOPERATIVE TASKS
+ */
+
+/* Steps of the cooperative tasks, each runs at most one transfer. */
+enum
+{
+    MCP7940M_INIT_STEP_LOAD = 0, /* RTCSEC..ALM1MTH -> shadow cache */
+    MCP7940M_INIT_STEP_START     /* Set ST if it is clear */
+};
+
+enum
+{
+    MCP7940M_GET_STEP_BURST = 0, /* RTCSEC..RTCYEAR */
+    MCP7940M_GET_STEP_CHECK,    /* RTCSEC again after a burst at second 59 */
+    MCP7940M_GET_STEP_REPEAT    /* RTCSEC..RTCYEAR after a rollover */
+};
+
+enum
+{
+    MCP7940M_ALARM_STEP_POLARITY = 0, /* ALM0WKDAY, to keep ALMPOL */
+    MCP7940M_ALARM_STEP_BANK,         /* ALMxSEC..ALMxMTH <- alarm */
+    MCP7940M_ALARM_STEP_CONTROL,      /* CONTROL into the shadow cache */
+    MCP7940M_ALARM_STEP_ENABLE        /* CONTROL <- ALMxEN */
+};
+
+enum
+{
+    MCP7940M_CAL_STEP_CONTROL = 0, /* CONTROL into the shadow cache */
+    MCP7940M_CAL_STEP_WINDOW,      /* OSCTRIM, rounds the window to whole trim periods */
+    MCP7940M_CAL_STEP_ENABLE,      /* CONTROL <- 1 Hz square wave */
+    MCP7940M_CAL_STEP_WAIT,        /* Measurement window, no bus access */
+    MCP7940M_CAL_STEP_TRIM,        /* OSCTRIM */
+    MCP7940M_CAL_STEP_MODE,        /* CONTROL for CRSTRIM, usually from the shadow cache */
+    MCP7940M_CAL_STEP_FINE,        /* CONTROL <- CRSTRIM clear, if leaving coarse mode */
+    MCP7940M_CAL_STEP_APPLY,       /* OSCTRIM <- corrected trim */
+    MCP7940M_CAL_STEP_COARSE       /* CONTROL <- CRSTRIM set, if entering coarse mode */
+};
+
+/**
+ * @brief  Starts the warm-start initialization of MCP7940M_InitTransport as a task.
+ * @note   The struct is set up immediately, the bus is only used by MCP7940M_Poll.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state, owned by the caller.
+ * @param  p_transport Bus access functions, must stay valid.
+ * @param  p_busContext Passed to every transport function.
+ * @retval HAL_OK if started, HAL_BUSY if p_task is still running.
+ */
+HAL_StatusTypeDef MCP7940M_BeginInit(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, const MCP7940M_Transport *p_transport, void *p_busContext)
+{
+    if (p_task->op != MCP7940M_TASK_NONE)
+    {
+        return HAL_BUSY;
+    }
+    MCP7940M_InitFields(p_mcp7940m, p_transport, p_busContext);
+    p_task->op = MCP7940M_TASK_INIT;
+    p_task->step = MCP7940M_INIT_STEP_LOAD;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Starts MCP7940M_GetTime as a task.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state, owned by the caller.
+ * @retval HAL_OK if started, HAL_BUSY if p_task is still running.
+ */
+HAL_StatusTypeDef MCP7940M_BeginGetTime(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task)
+{
+    (void)p_mcp7940m;
+    if (p_task->op != MCP7940M_TASK_NONE)
+    {
+        return HAL_BUSY;
+    }
+    p_task->op = MCP7940M_TASK_GET_TIME;
+    p_task->step = MCP7940M_GET_STEP_BURST;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Starts MCP7940M_SetTime as a task, writing the time fields of the struct.
+ * @note   The OSCRUN wait is polled, one RTCWKDAY read per call.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state, owned by the caller.
+ * @retval HAL_OK if started, HAL_BUSY if p_task is still running.
+ */
+HAL_StatusTypeDef MCP7940M_BeginSetTime(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task)
+{
+    (void)p_mcp7940m;
+    if (p_task->op != MCP7940M_TASK_NONE)
+    {
+        return HAL_BUSY;
+    }
+    p_task->op = MCP7940M_TASK_SET_TIME;
+    p_task->step = MCP7940M_SET_STEP_STOP;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Starts MCP7940M_SetAlarm as a task.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state, owned by the caller.
+ * @param  alarm MCP7940M_ALARM_0 or MCP7940M_ALARM_1.
+ * @param  p_alarm Alarm time and match mask, copied.
+ * @retval HAL_OK if started, HAL_BUSY if p_task is still running.
+ */
+HAL_StatusTypeDef MCP7940M_BeginSetAlarm(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, MCP7940M_AlarmIndex alarm, const MCP7940M_Alarm *p_alarm)
+{
+    (void)p_mcp7940m;
+    if (p_task->op != MCP7940M_TASK_NONE)
+    {
+        return HAL_BUSY;
+    }
+    p_task->op = MCP7940M_TASK_SET_ALARM;
+    p_task->step = MCP7940M_ALARM_STEP_POLARITY;
+    p_task->alarm = alarm;
+    p_task->alarmTime = *p_alarm;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Starts a complete calibration as a task: MCP7940M_CalibrationStart,
+ *         the measurement window and MCP7940M_CalibrationApply.
+ * @note   Feed the MFP (and PPS) edges as for MCP7940M_CalibrationStart. The
+ *         task keeps returning HAL_BUSY without bus access until the window
+ *         is complete. As there, the window is rounded up to a multiple of
+ *         MCP7940M_TRIM_PERIOD if a trim is active.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state, owned by the caller.
+ * @param  p_cal Calibration state, owned by the caller.
+ * @param  refHz Nominal frequency of the reference timer.
+ * @param  seconds Length of the measurement window.
+ * @retval HAL_OK if started, HAL_BUSY if p_task is still running.
+ */
+HAL_StatusTypeDef MCP7940M_BeginCalibration(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, MCP7940M_Calibration *p_cal, uint32_t refHz,
+                                            uint32_t seconds)
+{
+    (void)p_mcp7940m;
+    if (p_task->op != MCP7940M_TASK_NONE)
+    {
+        return HAL_BUSY;
+    }
+    MCP7940M_CalibrationReset(p_cal, refHz, seconds);
+    p_task->op = MCP7940M_TASK_CALIBRATE;
+    p_task->step = MCP7940M_CAL_STEP_CONTROL;
+    p_task->p_cal = p_cal;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Advances a task by one step, call from the superloop.
+ * @note   Blocks for at most one register transfer (with its retries). Do not
+ *         run a task and an _IT operation on the same device at once.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state.
+ * @retval HAL_BUSY while the task is running, otherwise its result, which is
+ *         also returned by every further call until a new task is begun.
+ */
+HAL_StatusTypeDef MCP7940M_Poll(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task)
+{
+    HAL_StatusTypeDef status;
+
+    if (p_task->op == MCP7940M_TASK_NONE)
+    {
+        return p_task->status;
+    }
+
+    status = MCP7940M_PollStep(p_mcp7940m, p_task);
+    if (status != HAL_BUSY)
+    {
+        p_task->op = MCP7940M_TASK_NONE;
+        p_task->status = status;
+    }
+    return status;
+}
+
+/**
+ * @brief  Runs the current step of a task.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_task Task state.
+ * @retval HAL_BUSY to continue with p_task->step, otherwise the result.
+ */
+static HAL_StatusTypeDef MCP7940M_PollStep(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task)
+{
+    HAL_StatusTypeDef status;
+    uint8_t data;
+    int8_t trim;
+
+    switch (p_task->op)
+    {
+    case MCP7940M_TASK_INIT:
+        if (p_task->step == MCP7940M_INIT_STEP_LOAD)
+        {
+            status = MCP7940M_LoadCache(p_mcp7940m);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_mcp7940m->shadow);
+            p_task->step = MCP7940M_INIT_STEP_START;
+            return HAL_BUSY;
+        }
+        return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, MCP7940M_RTCSEC_ST, MCP7940M_RTCSEC_ST); // Served from the cache.
+
+    case MCP7940M_TASK_GET_TIME:
+        if (p_task->step == MCP7940M_GET_STEP_CHECK)
+        {
+            status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, &data);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            if (data != p_task->regs[0])
+            {
+                p_task->step = MCP7940M_GET_STEP_REPEAT;
+                return HAL_BUSY;
+            }
+            MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_task->regs);
+            return HAL_OK;
+        }
+
+        status = MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, p_task->regs, MCP7940M_TIME_REG_COUNT);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        if (p_task->step == MCP7940M_GET_STEP_BURST && (p_task->regs[0] & 0b01111111) == 0x59)
+        {
+            p_task->step = MCP7940M_GET_STEP_CHECK; // The minute may have rolled over during the burst.
+            return HAL_BUSY;
+        }
+        MCP7940M_DecodeTimeRegisters(p_mcp7940m, p_task->regs);
+        return HAL_OK;
+
+    case MCP7940M_TASK_SET_TIME:
+        switch (p_task->step)
+        {
+        case MCP7940M_SET_STEP_STOP:
+            status = MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, 0);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->start = p_mcp7940m->transport->getTick(p_mcp7940m->busContext);
+            p_task->step = MCP7940M_SET_STEP_OSCRUN;
+            return HAL_BUSY;
+
+        case MCP7940M_SET_STEP_OSCRUN:
+            status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, &data);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            if (data & MCP7940M_RTCWKDAY_OSCRUN)
+            {
+                if ((p_mcp7940m->transport->getTick(p_mcp7940m->busContext) - p_task->start) >= MCP7940M_OSCRUN_TIMEOUT)
+                {
+                    return HAL_TIMEOUT;
+                }
+                return HAL_BUSY;
+            }
+            p_task->step = MCP7940M_SET_STEP_BURST;
+            return HAL_BUSY;
+
+        default: /* MCP7940M_SET_STEP_BURST */
+            MCP7940M_EncodeTimeRegisters(p_mcp7940m, p_task->regs);
+            return MCP7940M_WriteRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, p_task->regs, MCP7940M_TIME_REG_COUNT);
+        }
+
+    case MCP7940M_TASK_SET_ALARM:
+        switch (p_task->step)
+        {
+        case MCP7940M_ALARM_STEP_POLARITY:
+            p_task->regs[0] = 0;
+            if (p_task->alarm == MCP7940M_ALARM_0)
+            {
+                /* ALMPOL shares ALM0WKDAY with the rest of bank 0, keep its current value. */
+                status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_ALM0WKDAY, &p_task->regs[0], 1);
+                if (status != HAL_OK)
+                {
+                    return status;
+                }
+                p_task->regs[0] &= MCP7940M_ALMWKDAY_ALMPOL;
+            }
+            p_task->step = MCP7940M_ALARM_STEP_BANK;
+            return HAL_BUSY;
+
+        case MCP7940M_ALARM_STEP_BANK:
+            MCP7940M_EncodeAlarm(p_mcp7940m, &p_task->alarmTime, p_task->regs[0], p_task->regs);
+            status = MCP7940M_WriteRegisters(p_mcp7940m, MCP7940M_AlarmBase[p_task->alarm], p_task->regs, MCP7940M_ALARM_REG_COUNT);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_ALARM_STEP_CONTROL;
+            return HAL_BUSY;
+
+        case MCP7940M_ALARM_STEP_CONTROL:
+            status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, &data, 1);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_ALARM_STEP_ENABLE;
+            return HAL_BUSY;
+
+        default: /* MCP7940M_ALARM_STEP_ENABLE */
+            return MCP7940M_EnableAlarm(p_mcp7940m, p_task->alarm, 1); // CONTROL is cached, one write at most.
+        }
+
+    case MCP7940M_TASK_CALIBRATE:
+        switch (p_task->step)
+        {
+        case MCP7940M_CAL_STEP_CONTROL:
+            status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, &data, 1);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_CAL_STEP_WINDOW;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_WINDOW:
+            status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_OSCTRIM, &data, 1);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            MCP7940M_CalibrationWindow(p_task->p_cal, data);
+            p_task->step = MCP7940M_CAL_STEP_ENABLE;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_ENABLE:
+            status = MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL,
+                                             MCP7940M_CONTROL_SQWEN | MCP7940M_CONTROL_CRSTRIM | MCP7940M_CONTROL_SQWFS,
+                                             MCP7940M_CONTROL_SQWEN | MCP7940M_SQWFS_1HZ);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_CAL_STEP_WAIT;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_WAIT:
+            if (!MCP7940M_CalibrationDone(p_task->p_cal))
+            {
+                return HAL_BUSY;
+            }
+            status = MCP7940M_CalibrationGetError(p_task->p_cal, &p_task->errorPpb);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_CAL_STEP_TRIM;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_TRIM:
+            status = MCP7940M_GetTrim(p_mcp7940m, &trim);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            p_task->regs[0] = (uint8_t)trim;
+            p_task->step = MCP7940M_CAL_STEP_MODE;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_MODE:
+            status = MCP7940M_CacheRead(p_mcp7940m, MCP7940M_REG_CONTROL, &p_task->regs[1], 1);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+            /* regs: trim and CONTROL during the measurement, then the new ones */
+            MCP7940M_TrimAdjusted((int8_t)p_task->regs[0], p_task->regs[1], p_mcp7940m->tickState == MCP7940M_TICK_STOPPED,
+                                  p_task->errorPpb, &trim, &p_task->regs[3]);
+            p_task->regs[2] = (uint8_t)trim;
+            if (p_task->regs[2] == p_task->regs[0] && p_task->regs[3] == p_task->regs[1])
+            {
+                return HAL_OK;
+            }
+            p_task->step = MCP7940M_CAL_STEP_FINE;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_FINE:
+            if ((p_task->regs[1] & MCP7940M_CONTROL_CRSTRIM) && !(p_task->regs[3] & MCP7940M_CONTROL_CRSTRIM))
+            {
+                status = MCP7940M_SetCoarseTrim(p_mcp7940m, 0);
+                if (status != HAL_OK)
+                {
+                    return status;
+                }
+            }
+            p_task->step = MCP7940M_CAL_STEP_APPLY;
+            return HAL_BUSY;
+
+        case MCP7940M_CAL_STEP_APPLY:
+            status = MCP7940M_SetTrim(p_mcp7940m, (int8_t)p_task->regs[2]);
+            if (status != HAL_OK || (p_task->regs[1] & MCP7940M_CONTROL_CRSTRIM) || !(p_task->regs[3] & MCP7940M_CONTROL_CRSTRIM))
+            {
+                return status;
+            }
+            p_task->step = MCP7940M_CAL_STEP_COARSE;
+            return HAL_BUSY;
+
+        default: /* MCP7940M_CAL_STEP_COARSE */
+            return MCP7940M_SetCoarseTrim(p_mcp7940m, 1);
+        }
+
+    default:
+        return HAL_ERROR;
+    }
+}
+
+/*
+ * SRAM
+ */
+
+/**
+ * @brief  Reads SRAM bytes in one burst.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  offset First byte, 0..MCP7940M_SRAM_SIZE - 1.
+ * @param  p_data Receives length bytes.
+ * @param  length Number of bytes.
+ * @retval HAL status of the transfer, HAL_ERROR if the range leaves the SRAM.
+ */
+HAL_StatusTypeDef MCP7940M_ReadSram(MCP7940M *p_mcp7940m, uint8_t offset, uint8_t *p_data, uint8_t length)
+{
+    if (length == 0 || (uint16_t)offset + length > MCP7940M_SRAM_SIZE)
+    {
+        return HAL_ERROR;
+    }
+    return MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_SRAM + offset, p_data, length);
+}
+
+/**
+ * @brief  Writes SRAM bytes in one burst.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  offset First byte, 0..MCP7940M_SRAM_SIZE - 1.
+ * @param  p_data length bytes to write.
+ * @param  length Number of bytes.
+ * @retval HAL status of the transfer, HAL_ERROR if the range leaves the SRAM.
+ */
+HAL_StatusTypeDef MCP7940M_WriteSram(MCP7940M *p_mcp7940m, uint8_t offset, const uint8_t *p_data, uint8_t length)
+{
+    if (length == 0 || (uint16_t)offset + length > MCP7940M_SRAM_SIZE)
+    {
+        return HAL_ERROR;
+    }
+    return MCP7940M_WriteRegisters(p_mcp7940m, MCP7940M_REG_SRAM + offset, p_data, length);
+}
+
+/**
+ * @brief  Creates an empty ring, clearing the tags of its region.
+ * @note   Required after power-up, when the SRAM contents are undefined.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_ring Ring state.
+ * @param  base SRAM offset of the region.
+ * @param  slotSize Bytes per slot, record length plus one for the tag.
+ * @param  slotCount Number of slots, at least 2.
+ * @retval HAL status of the transfer, HAL_ERROR if the region does not fit.
+ */
+HAL_StatusTypeDef MCP7940M_RingFormat(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, uint8_t base, uint8_t slotSize, uint8_t slotCount)
+{
+    uint8_t region[MCP7940M_SRAM_SIZE];
+    uint16_t length = (uint16_t)slotSize * slotCount;
+
+    if (MCP7940M_RingCheck(base, slotSize, slotCount) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+
+    p_ring->base = base;
+    p_ring->slotSize = slotSize;
+    p_ring->slotCount = slotCount;
+    p_ring->next = 0;
+    p_ring->sequence = 1;
+    p_ring->count = 0;
+
+    memset(region, 0, length);
+    return MCP7940M_WriteSram(p_mcp7940m, base, region, (uint8_t)length);
+}
+
+/**
+ * @brief  Recovers a ring after an MCU reset from one burst read of its region.
+ * @note   The newest record is the end of the longest run of consecutive tags.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_ring Ring state.
+ * @param  base SRAM offset of the region, as formatted.
+ * @param  slotSize Bytes per slot, as formatted.
+ * @param  slotCount Number of slots, as formatted.
+ * @retval HAL status of the transfer, HAL_ERROR if the region does not fit.
+ */
+HAL_StatusTypeDef MCP7940M_RingMount(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, uint8_t base, uint8_t slotSize, uint8_t slotCount)
+{
+    uint8_t region[MCP7940M_SRAM_SIZE];
+    uint8_t slot;
+    uint8_t run;
+    uint8_t best = 0;
+    uint8_t head = 0;
+    uint8_t previous;
+    HAL_StatusTypeDef status;
+
+    if (MCP7940M_RingCheck(base, slotSize, slotCount) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    status = MCP7940M_ReadSram(p_mcp7940m, base, region, (uint8_t)(slotSize * slotCount));
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    /* A newest record is a tagged slot not followed by its successor tag. */
+    for (slot = 0; slot < slotCount; slot++)
+    {
+        if (region[slot * slotSize] == 0 || region[((slot + 1) % slotCount) * slotSize] == MCP7940M_RingNextTag(region[slot * slotSize]))
+        {
+            continue;
+        }
+        for (run = 1; run < slotCount; run++)
+        {
+            previous = (uint8_t)((slot + slotCount - run) % slotCount);
+            if (MCP7940M_RingNextTag(region[previous * slotSize]) != region[((previous + 1) % slotCount) * slotSize] || region[previous * slotSize] == 0)
+            {
+                break;
+            }
+        }
+        if (run > best)
+        {
+            best = run;
+            head = slot;
+        }
+    }
+
+    p_ring->base = base;
+    p_ring->slotSize = slotSize;
+    p_ring->slotCount = slotCount;
+    p_ring->count = best;
+    if (best == 0)
+    {
+        p_ring->next = 0;
+        p_ring->sequence = 1;
+    }
+    else
+    {
+        p_ring->next = (uint8_t)((head + 1) % slotCount);
+        p_ring->sequence = MCP7940M_RingNextTag(region[head * slotSize]);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Appends a record with a single write of one slot, overwriting the oldest when full.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_ring Ring state.
+ * @param  p_record slotSize - 1 bytes.
+ * @retval HAL status of the transfer.
+ */
+HAL_StatusTypeDef MCP7940M_RingAppend(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, const uint8_t *p_record)
+{
+    uint8_t slot[MCP7940M_SRAM_SIZE];
+    HAL_StatusTypeDef status;
+
+    slot[0] = p_ring->sequence;
+    memcpy(&slot[1], p_record, p_ring->slotSize - 1U);
+    status = MCP7940M_WriteSram(p_mcp7940m, p_ring->base + p_ring->next * p_ring->slotSize, slot, p_ring->slotSize);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    p_ring->next = (uint8_t)((p_ring->next + 1) % p_ring->slotCount);
+    p_ring->sequence = MCP7940M_RingNextTag(p_ring->sequence);
+    if (p_ring->count < p_ring->slotCount)
+    {
+        p_ring->count++;
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Reads a record, 0 being the oldest held.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_ring Ring state.
+ * @param  index 0..count - 1.
+ * @param  p_record Receives slotSize - 1 bytes.
+ * @retval HAL status of the transfer, HAL_ERROR if index is not held.
+ */
+HAL_StatusTypeDef MCP7940M_RingRead(MCP7940M *p_mcp7940m, const MCP7940M_SramRing *p_ring, uint8_t index, uint8_t *p_record)
+{
+    uint8_t slot;
+
+    if (index >= p_ring->count)
+    {
+        return HAL_ERROR;
+    }
+    slot = (uint8_t)((p_ring->next + p_ring->slotCount - p_ring->count + index) % p_ring->slotCount);
+    return MCP7940M_ReadSram(p_mcp7940m, p_ring->base + slot * p_ring->slotSize + 1U, p_record, p_ring->slotSize - 1U);
+}
+
+/**
+ * @brief  Checks that a ring geometry fits the SRAM.
+ * @param  base SRAM offset of the region.
+ * @param  slotSize Bytes per slot including the tag.
+ * @param  slotCount Number of slots.
+ * @retval HAL_OK if usable, HAL_ERROR otherwise.
+ */
+static HAL_StatusTypeDef MCP7940M_RingCheck(uint8_t base, uint8_t slotSize, uint8_t slotCount)
+{
+    if (slotSize < 2 || slotCount < 2 || (uint16_t)base + (uint16_t)slotSize * slotCount > MCP7940M_SRAM_SIZE)
+    {
+        return HAL_ERROR;
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Sequence tag following tag, 0 is reserved for empty slots.
+ * @param  tag Current tag.
+ * @retval Next tag.
+ */
+static uint8_t MCP7940M_RingNextTag(uint8_t tag)
+{
+    return (tag == 255) ? 1 : (uint8_t)(tag + 1);
+}
+
+/*
+ * REGISTER DUMP
+ */
+
+/**
+ * @brief  Writes a raw register dump.
+ * @note   One burst for RTCSEC..ALM1MTH, which also refreshes the shadow
+ *         cache, and one for the SRAM if requested.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_buffer Receives the dump, MCP7940M_DUMP_MAX_SIZE bytes are enough.
+ * @param  withSram 1 to include the SRAM.
+ * @param  p_length Receives the length of the dump.
+ * @retval HAL status of the reads.
+ */
+HAL_StatusTypeDef MCP7940M_Dump(MCP7940M *p_mcp7940m, uint8_t *p_buffer, uint8_t withSram, uint16_t *p_length)
+{
+    HAL_StatusTypeDef status;
+
+    p_buffer[0] = MCP7940M_DUMP_MAGIC;
+    p_buffer[1] = MCP7940M_DUMP_VERSION;
+    p_buffer[2] = withSram ? MCP7940M_DUMP_FLAG_SRAM : 0;
+    p_buffer[3] = MCP7940M_REG_MAP_SIZE;
+
+    status = MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, p_buffer + MCP7940M_DUMP_HEADER_SIZE, MCP7940M_REG_MAP_SIZE);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    *p_length = MCP7940M_DUMP_HEADER_SIZE + MCP7940M_REG_MAP_SIZE;
+
+    if (withSram)
+    {
+        status = MCP7940M_ReadSram(p_mcp7940m, 0, p_buffer + *p_length, MCP7940M_SRAM_SIZE);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        *p_length += MCP7940M_SRAM_SIZE;
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Locates the parts of a register dump.
+ * @note   Dumps with a longer register map, written by a later version of the
+ *         format, are accepted and their first MCP7940M_REG_MAP_SIZE registers used.
+ * @param  p_data Start of the dump.
+ * @param  available Bytes available at p_data.
+ * @param  p_view Receives pointers into p_data.
+ * @retval Length of the dump, so the next one starts at p_data + length.
+ *         0 if the header is not a dump or the dump is truncated.
+ */
+uint16_t MCP7940M_DumpParse(const uint8_t *p_data, uint32_t available, MCP7940M_DumpView *p_view)
+{
+    uint16_t length;
+
+    if (available < MCP7940M_DUMP_HEADER_SIZE || p_data[0] != MCP7940M_DUMP_MAGIC || p_data[1] < MCP7940M_DUMP_VERSION ||
+        p_data[3] < MCP7940M_REG_MAP_SIZE)
+    {
+        return 0;
+    }
+
+    length = MCP7940M_DUMP_HEADER_SIZE + p_data[3] + ((p_data[2] & MCP7940M_DUMP_FLAG_SRAM) ? MCP7940M_SRAM_SIZE : 0);
+    if (length > available)
+    {
+        return 0;
+    }
+
+    p_view->version = p_data[1];
+    p_view->flags = p_data[2];
+    p_view->p_regs = p_data + MCP7940M_DUMP_HEADER_SIZE;
+    p_view->p_sram = (p_data[2] & MCP7940M_DUMP_FLAG_SRAM) ? p_view->p_regs + p_data[3] : NULL;
+    return length;
+}
+
+/*
+ * EVENT CAPTURE
+ */
+
+/**
+ * @brief  Empties an event queue.
+ * @param  p_queue Pointer to the queue.
+ * @param  timerRead Free running timer the events are stamped with.
+ * @param  tickHz Frequency of that timer.
+ */
+void MCP7940M_EventQueueInit(MCP7940M_EventQueue *p_queue, MCP7940M_TimerRead timerRead, uint32_t tickHz)
+{
+    p_queue->head = 0;
+    p_queue->tail = 0;
+    p_queue->dropped = 0;
+    p_queue->timerRead = timerRead;
+    p_queue->tickHz = tickHz;
+    p_queue->anchorValid = 0;
+}
+
+/**
+ * @brief  Queues an event, called from the interrupt that observed it.
+ * @note   Costs a few stores and no bus access. Only one context may push.
+ * @param  p_queue Pointer to the queue.
+ * @param  id Event identifier.
+ * @param  tick Timer value at the event, from the queue's timer.
+ * @retval 1 if queued, 0 if the queue was full and the event was dropped.
+ */
+uint8_t MCP7940M_EventPush(MCP7940M_EventQueue *p_queue, uint32_t id, uint32_t tick)
+{
+    uint32_t head = p_queue->head;
+    MCP7940M_Event *p_event;
+
+    if (head - p_queue->tail >= MCP7940M_EVENT_QUEUE_SIZE)
+    {
+        p_queue->dropped++;
+        return 0;
+    }
+
+    p_event = &p_queue->events[head & (MCP7940M_EVENT_QUEUE_SIZE - 1)];
+    p_event->id = id;
+    p_event->tick = tick;
+    __DMB(); // Event must be visible before head.
+    p_queue->head = head + 1;
+    return 1;
+}
+
+/**
+ * @brief  Converts the queued events to RTC time and hands them to handler.
+ * @note   Call from the background worker. The anchor is renewed only when
+ *         events are pending and it is a second or more old: from the 1 Hz
+ *         counter without bus access if it runs on the queue's timer,
+ *         otherwise with a single burst read.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_queue Pointer to the queue.
+ * @param  handler Called once per event in queued order.
+ * @param  p_context Passed to handler.
+ * @retval HAL_OK, or the status of the anchor read with the events left queued.
+ */
+HAL_StatusTypeDef MCP7940M_EventProcess(MCP7940M *p_mcp7940m, MCP7940M_EventQueue *p_queue, MCP7940M_EventHandler handler, void *p_context)
+{
+    const MCP7940M_Event *p_event;
+    MCP7940M_EventStamp stamp;
+    uint32_t tail = p_queue->tail;
+    int32_t delta;
+    int32_t seconds;
+    HAL_StatusTypeDef status;
+
+    if (tail == p_queue->head || p_queue->tickHz == 0)
+    {
+        return HAL_OK;
+    }
+    if (!p_queue->anchorValid || (p_queue->timerRead() - p_queue->anchorTick) >= p_queue->tickHz)
+    {
+        status = MCP7940M_EventAnchor(p_mcp7940m, p_queue);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+    }
+
+    while (tail != p_queue->head)
+    {
+        __DMB(); // Read the event after seeing head.
+        p_event = &p_queue->events[tail & (MCP7940M_EVENT_QUEUE_SIZE - 1)];
+
+        delta = (int32_t)(p_event->tick - p_queue->anchorTick);
+        seconds = delta / (int32_t)p_queue->tickHz;
+        if (delta < 0 && seconds * (int32_t)p_queue->tickHz != delta)
+        {
+            seconds--; // Round towards the earlier second.
+        }
+        stamp.id = p_event->id;
+        stamp.epoch = p_queue->anchorEpoch + (uint32_t)seconds;
+        stamp.fraction = (uint32_t)(delta - seconds * (int32_t)p_queue->tickHz);
+
+        tail++;
+        p_queue->tail = tail;
+        handler(p_context, &stamp);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Takes a new (epoch, tick) anchor for the event conversion.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_queue Pointer to the queue.
+ * @retval HAL status of the read, HAL_OK when served by the 1 Hz counter.
+ */
+static HAL_StatusTypeDef MCP7940M_EventAnchor(MCP7940M *p_mcp7940m, MCP7940M_EventQueue *p_queue)
+{
+    MCP7940M_Time time;
+    uint32_t before;
+    uint32_t epoch;
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->tickState == MCP7940M_TICK_RUNNING && p_mcp7940m->timerRead == p_queue->timerRead &&
+        p_mcp7940m->timerHz == p_queue->tickHz)
+    {
+        /* Exact: the counter holds the timer value of the last 1 Hz edge. */
+        MCP7940M_SnapshotRead(&p_mcp7940m->tick, &time, &p_queue->anchorTick);
+        p_queue->anchorEpoch = MCP7940M_TimeToEpoch(&time);
+        p_queue->anchorValid = (p_queue->anchorEpoch != MCP7940M_EPOCH_INVALID) ? 1 : 0;
+        return p_queue->anchorValid ? HAL_OK : HAL_ERROR;
+    }
+
+    /* Within a second: the phase of the RTC second is not known. */
+    before = p_queue->timerRead();
+    status = MCP7940M_GetEpoch(p_mcp7940m, &epoch);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_queue->anchorTick = before + (p_queue->timerRead() - before) / 2;
+    p_queue->anchorEpoch = epoch;
+    p_queue->anchorValid = 1;
+    return HAL_OK;
+}
+
+/*
+ * 1 HZ SECOND COUNTER
+ */
+
+/**
+ * @brief  Starts counting time from the 1 Hz square wave on MFP.
+ * @note   Enables SQWEN with SQWFS = 1 Hz and reads the time once between two
+ *         edges. From then on MCP7940M_SecondTickCallback, called from the EXTI
+ *         interrupt on the MFP edge at which RTCSEC increments, advances the
+ *         time and MCP7940M_Now returns it without any bus access. The MFP
+ *         interrupt must be enabled and must not be masked while this runs.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  timerRead Returns a free-running timer value, e.g. a TIM counter.
+ * @param  timerHz Frequency of the timer, i.e. sub-second ticks per second.
+ * @retval HAL status of the CONTROL transfers or the time read, HAL_BUSY if
+ *         every read was interrupted by an edge, HAL_ERROR in coarse trim
+ *         mode, where MFP runs at 64 Hz.
+ */
+HAL_StatusTypeDef MCP7940M_StartSecondCounter(MCP7940M *p_mcp7940m, MCP7940M_TimerRead timerRead, uint32_t timerHz)
+{
+    HAL_StatusTypeDef status;
+    uint8_t coarse;
+
+    status = MCP7940M_GetCoarseTrim(p_mcp7940m, &coarse);
+    if (status != HAL_OK || coarse)
+    {
+        return (status != HAL_OK) ? status : HAL_ERROR;
+    }
+
+    p_mcp7940m->tickState = MCP7940M_TICK_STOPPED;
+    p_mcp7940m->timerRead = timerRead;
+    p_mcp7940m->timerHz = timerHz;
+    __DMB();
+    p_mcp7940m->tickState = MCP7940M_TICK_ARMED; // Count edges from here on, none may be lost.
+
+    status = MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN | MCP7940M_CONTROL_SQWFS,
+                                     MCP7940M_CONTROL_SQWEN | MCP7940M_SQWFS_1HZ);
+    if (status == HAL_OK)
+    {
+        status = MCP7940M_SecondCounterSync(p_mcp7940m);
+    }
+    if (status != HAL_OK)
+    {
+        p_mcp7940m->tickState = MCP7940M_TICK_STOPPED;
+        p_mcp7940m->timerRead = NULL;
+    }
+    return status;
+}
+
+/**
+ * @brief  Stops the second counter and the square wave output.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the CONTROL write.
+ */
+HAL_StatusTypeDef MCP7940M_StopSecondCounter(MCP7940M *p_mcp7940m)
+{
+    p_mcp7940m->tickState = MCP7940M_TICK_STOPPED;
+    p_mcp7940m->timerRead = NULL;
+    return MCP7940M_UpdateRegister(p_mcp7940m, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN, 0);
+}
+
+/**
+ * @brief  Re-reads the time of a running second counter from the chip.
+ * @note   Call after the time was set, or periodically if MFP interrupts may
+ *         have been missed. The counter keeps running and the next edge
+ *         continues from the chip's time. Same conditions as
+ *         MCP7940M_StartSecondCounter.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the time read, HAL_BUSY if every read was interrupted
+ *         by an edge, HAL_ERROR if the counter is not started.
+ */
+HAL_StatusTypeDef MCP7940M_ResyncSecondCounter(MCP7940M *p_mcp7940m)
+{
+    if (p_mcp7940m->tickState == MCP7940M_TICK_STOPPED)
+    {
+        return HAL_ERROR;
+    }
+    return MCP7940M_SecondCounterSync(p_mcp7940m);
+}
+
+/**
+ * @brief  Reads the time between two edges and hands it to the next edge.
+ * @note   A read is only used if no edge was counted while it ran, otherwise
+ *         it could be from either side of the increment. Edges that arrive
+ *         after the read are counted and added by the next edge.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the time read, HAL_BUSY if every read saw an edge.
+ */
+static HAL_StatusTypeDef MCP7940M_SecondCounterSync(MCP7940M *p_mcp7940m)
+{
+    HAL_StatusTypeDef status;
+    uint32_t edges;
+    uint8_t attempt;
+
+    for (attempt = 0; attempt < MCP7940M_TICK_SYNC_ATTEMPTS; attempt++)
+    {
+        edges = p_mcp7940m->tickEdges;
+        __DMB();
+        status = MCP7940M_GetTime(p_mcp7940m);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        __DMB();
+        if (p_mcp7940m->tickEdges != edges)
+        {
+            continue;
+        }
+
+        if (p_mcp7940m->tickState == MCP7940M_TICK_SYNC)
+        {
+            p_mcp7940m->tickState = MCP7940M_TICK_ARMED; // The edge must not take over syncTime while it is written.
+            __DMB();
+        }
+        MCP7940M_GetTimeFields(p_mcp7940m, &p_mcp7940m->syncTime);
+        p_mcp7940m->syncEdges = edges;
+        if (p_mcp7940m->tickState == MCP7940M_TICK_ARMED)
+        {
+            // Whole seconds for MCP7940M_Now until the first edge, the callback does not publish yet.
+            MCP7940M_SnapshotPublish(&p_mcp7940m->tick, &p_mcp7940m->syncTime, p_mcp7940m->timerRead());
+        }
+        __DMB();
+        p_mcp7940m->tickState = MCP7940M_TICK_SYNC;
+        return HAL_OK;
+    }
+    return HAL_BUSY;
+}
+
+/**
+ * @brief  Call from the EXTI interrupt of the MFP pin.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ */
+void MCP7940M_SecondTickCallback(MCP7940M *p_mcp7940m)
+{
+    MCP7940M_Time time;
+    uint32_t timer;
+    uint32_t edges;
+    uint8_t state = p_mcp7940m->tickState;
+
+    if (state == MCP7940M_TICK_STOPPED)
+    {
+        return;
+    }
+
+    timer = p_mcp7940m->timerRead();
+    edges = p_mcp7940m->tickEdges + 1;
+    p_mcp7940m->tickEdges = edges;
+
+    if (state == MCP7940M_TICK_SYNC)
+    {
+        time = p_mcp7940m->syncTime;
+        for (edges -= p_mcp7940m->syncEdges; edges > 0; edges--)
+        {
+            MCP7940M_IncrementTime(&time);
+        }
+        MCP7940M_SnapshotPublish(&p_mcp7940m->tick, &time, timer);
+        p_mcp7940m->tickState = MCP7940M_TICK_RUNNING;
+    }
+    else if (state == MCP7940M_TICK_RUNNING)
+    {
+        MCP7940M_SnapshotRead(&p_mcp7940m->tick, &time, NULL);
+        MCP7940M_IncrementTime(&time);
+        MCP7940M_SnapshotPublish(&p_mcp7940m->tick, &time, timer);
+    }
+}
+
+/**
+ * @brief  Returns the counted time without bus access.
+ * @note   Requires MCP7940M_StartSecondCounter. Safe to call from any context.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_time Receives the time of the last 1 Hz edge.
+ * @param  p_subseconds Receives the timer ticks elapsed since that edge,
+ *                      limited to timerHz - 1, 0 until the first edge after
+ *                      the start. May be NULL.
+ */
+void MCP7940M_Now(MCP7940M *p_mcp7940m, MCP7940M_Time *p_time, uint32_t *p_subseconds)
+{
+    uint32_t edge;
+    uint32_t elapsed;
+
+    MCP7940M_SnapshotRead(&p_mcp7940m->tick, p_time, &edge);
+    if (p_subseconds != NULL)
+    {
+        if (p_mcp7940m->tickState != MCP7940M_TICK_RUNNING || p_mcp7940m->timerHz == 0)
+        {
+            *p_subseconds = 0;
+            return;
+        }
+        elapsed = p_mcp7940m->timerRead() - edge;
+        *p_subseconds = (elapsed < p_mcp7940m->timerHz) ? elapsed : p_mcp7940m->timerHz - 1;
+    }
+}
+
+/*
+ * BUS TIMING AND RECOVERY
+ */
+
+/**
+ * @brief  Tells the driver the SCL frequency the bus is configured for.
+ * @note   The driver does not reconfigure the I2C peripheral, this only sets
+ *         the per transfer timeouts (see MCP7940M_TransferTimeout).
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  busHz SCL frequency, at most MCP7940M_MAX_BUS_HZ.
+ * @param  timeoutMargin ms added to the wire time, covers clock stretching,
+ *                       interrupt latency and the 1 ms tick granularity.
+ * @retval HAL_OK, HAL_ERROR if busHz is 0 or faster than the chip supports.
+ */
+HAL_StatusTypeDef MCP7940M_SetBusSpeed(MCP7940M *p_mcp7940m, uint32_t busHz, uint32_t timeoutMargin)
+{
+    if (busHz == 0 || busHz > MCP7940M_MAX_BUS_HZ)
+    {
+        return HAL_ERROR;
+    }
+    p_mcp7940m->busHz = busHz;
+    p_mcp7940m->timeoutMargin = timeoutMargin;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Computes the timeout of a register transfer.
+ * @note   A burst read is START, address, register, RESTART, address,
+ *         length bytes and STOP, i.e. (length + 3) * 9 + 3 SCL periods. Writes
+ *         are shorter, so the same bound is used for both.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  length Number of data bytes.
+ * @retval Timeout in ms.
+ */
+uint32_t MCP7940M_TransferTimeout(const MCP7940M *p_mcp7940m, uint16_t length)
+{
+    uint32_t bits = (length + 3UL) * 9UL + 3UL;
+    uint32_t wireMs = (bits * 1000UL + p_mcp7940m->busHz - 1) / p_mcp7940m->busHz;
+
+    return wireMs + p_mcp7940m->timeoutMargin;
+}
+
+/**
+ * @brief  Sets how often a failed blocking transfer is retried.
+ * @note   The waits between attempts are backoffMs, 2 * backoffMs, 4 * backoffMs...
+ *         Asynchronous transfers report failures to their callback instead.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  retries Retries after the first attempt, 0 to disable.
+ * @param  backoffMs Wait before the first retry.
+ */
+void MCP7940M_SetRetries(MCP7940M *p_mcp7940m, uint8_t retries, uint8_t backoffMs)
+{
+    p_mcp7940m->retries = retries;
+    p_mcp7940m->retryBackoff = backoffMs;
+}
+
+/**
+ * @brief  Installs the routine run after a transfer timed out.
+ * @note   HAL_BUSY is not treated as a stuck bus because the HAL also returns it
+ *         while another transfer owns the handle. Call MCP7940M_RecoverBus
+ *         directly if the bus is known to be stuck.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  busRecover Recovery routine, NULL to disable recovery.
+ * @param  p_context Passed to busRecover, e.g. a MCP7940M_HAL_BusPins.
+ */
+void MCP7940M_SetBusRecovery(MCP7940M *p_mcp7940m, MCP7940M_BusRecover busRecover, void *p_context)
+{
+    p_mcp7940m->busRecover = busRecover;
+    p_mcp7940m->recoverContext = p_context;
+}
+
+/**
+ * @brief  Runs the installed bus recovery.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL_ERROR without a recovery routine, otherwise its status.
+ */
+HAL_StatusTypeDef MCP7940M_RecoverBus(MCP7940M *p_mcp7940m)
+{
+    if (p_mcp7940m->busRecover == NULL)
+    {
+        return HAL_ERROR;
+    }
+    MCP7940M_STATS_ADD(p_mcp7940m, recoveries, 1);
+    return p_mcp7940m->busRecover(p_mcp7940m->recoverContext);
+}
+
+/*
+ * LOW POWER
+ */
+
+/**
+ * @brief  Installs hooks that power the bus up and down around every transfer.
+ * @note   Typically the I2C peripheral clock, e.g. MCP7940M_HAL_ClockEnable and
+ *         MCP7940M_HAL_ClockDisable, so it stays gated while the MCU sleeps.
+ *         The hooks must tolerate being called more than once in a row.
+ *         Asynchronous operations keep the bus powered until they finish.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  powerUp Called before a transfer starts, NULL for none.
+ * @param  powerDown Called after a transfer has ended, NULL for none.
+ * @param  p_context Passed to both hooks, e.g. the I2C handle.
+ */
+void MCP7940M_SetBusPower(MCP7940M *p_mcp7940m, MCP7940M_BusLock powerUp, MCP7940M_BusLock powerDown, void *p_context)
+{
+    p_mcp7940m->busPowerUp = powerUp;
+    p_mcp7940m->busPowerDown = powerDown;
+    p_mcp7940m->powerContext = p_context;
+}
+
+/**
+ * @brief  Updates the time after a sleep of known maximum length.
+ * @note   The struct must hold the last known time. Only the registers that
+ *         can have changed within maxElapsed seconds are read, in a single
+ *         burst: RTCSEC alone if the minute cannot have ended, up to RTCHOUR
+ *         within the day and all seven registers otherwise. If the fresh
+ *         value is behind the last known one the bound was wrong, and the
+ *         full time is read instead.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  maxElapsed Upper bound of the seconds since the time was last read,
+ *         e.g. the wake-up timer or alarm period.
+ * @retval HAL status of the transfer.
+ */
+HAL_StatusTypeDef MCP7940M_WakeGetTime(MCP7940M *p_mcp7940m, uint32_t maxElapsed)
+{
+    uint8_t regs[3];
+    uint32_t last;
+    uint32_t now;
+    uint8_t count;
+    HAL_StatusTypeDef status;
+
+    last = (uint32_t)p_mcp7940m->hours * 3600UL + (uint32_t)p_mcp7940m->minutes * 60UL + p_mcp7940m->seconds;
+    if (p_mcp7940m->seconds > 59 || p_mcp7940m->minutes > 59 || p_mcp7940m->hours > 23)
+    {
+        return MCP7940M_GetTime(p_mcp7940m);
+    }
+    if (maxElapsed < 60UL - p_mcp7940m->seconds)
+    {
+        count = 1;
+        last = p_mcp7940m->seconds;
+    }
+    else if (maxElapsed < 3600UL - (last % 3600UL))
+    {
+        count = 2;
+        last %= 3600UL;
+    }
+    else if (maxElapsed < 86400UL - last)
+    {
+        count = 3;
+    }
+    else
+    {
+        return MCP7940M_GetTime(p_mcp7940m);
+    }
+
+    status = MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, regs, count);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    now = MCP7940M_BCDDecode(regs[0] & 0b01111111);
+    if (count > 1)
+    {
+        now += MCP7940M_BCDDecode(regs[1] & 0b01111111) * 60UL;
+    }
+    if (count > 2)
+    {
+        now += MCP7940M_DecodeHours(regs[2]) * 3600UL;
+    }
+    if (now < last)
+    {
+        return MCP7940M_GetTime(p_mcp7940m);
+    }
+
+    p_mcp7940m->seconds = MCP7940M_BCDDecode(regs[0] & 0b01111111);
+    if (count > 1)
+    {
+        p_mcp7940m->minutes = MCP7940M_BCDDecode(regs[1] & 0b01111111);
+    }
+    if (count > 2)
+    {
+        p_mcp7940m->hours = MCP7940M_DecodeHours(regs[2]);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Runs the power up hook, if any.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ */
+static void MCP7940M_BusPowerUp(MCP7940M *p_mcp7940m)
+{
+    if (p_mcp7940m->busPowerUp != NULL)
+    {
+        p_mcp7940m->busPowerUp(p_mcp7940m->powerContext);
+    }
+}
+
+/**
+ * @brief  Runs the power down hook, if any.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ */
+static void MCP7940M_BusPowerDown(MCP7940M *p_mcp7940m)
+{
+    if (p_mcp7940m->busPowerDown != NULL)
+    {
+        p_mcp7940m->busPowerDown(p_mcp7940m->powerContext);
+    }
+}
+
+/*
+ * INSTRUMENTATION
+ */
+
+#ifdef MCP7940M_ENABLE_STATS
+/**
+ * @brief  Clears all counters of MCP7940M.stats.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ */
+void MCP7940M_ResetStats(MCP7940M *p_mcp7940m)
+{
+    uint8_t i;
+
+    memset(&p_mcp7940m->stats, 0, sizeof(p_mcp7940m->stats));
+    for (i = 0; i < MCP7940M_STATS_OP_COUNT; i++)
+    {
+        p_mcp7940m->stats.ops[i].minCycles = UINT32_MAX;
+    }
+}
+
+/**
+ * @brief  Adds one measurement to an operation's cycle statistics.
+ * @param  p_stats Statistics of the operation.
+ * @param  cycles Cycles the operation took.
+ */
+void MCP7940M_StatsRecord(MCP7940M_CycleStats *p_stats, uint32_t cycles)
+{
+    p_stats->count++;
+    p_stats->totalCycles += cycles;
+    if (cycles < p_stats->minCycles)
+    {
+        p_stats->minCycles = cycles;
+    }
+    if (cycles > p_stats->maxCycles)
+    {
+        p_stats->maxCycles = cycles;
+    }
+}
+
+#ifndef MCP7940M_NO_HAL
+/**
+ * @brief  Starts the DWT cycle counter the statistics are taken from.
+ * @note   Debuggers usually start it too, call this for standalone runs.
+ */
+void MCP7940M_EnableCycleCounter(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+#endif
+#endif /* MCP7940M_ENABLE_STATS */
+
+/**
+ * @brief  Counts a failed transfer by its status.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  status Status of the transfer, HAL_OK is not counted.
+ */
+static inline void MCP7940M_StatsStatus(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status)
+{
+#ifdef MCP7940M_ENABLE_STATS
+    if (status == HAL_TIMEOUT)
+    {
+        p_mcp7940m->stats.timeouts++;
+    }
+    else if (status != HAL_OK)
+    {
+        p_mcp7940m->stats.errors++;
+    }
+#else
+    (void)p_mcp7940m;
+    (void)status;
+#endif
+}
+
+/*
+ * LOW-LEVEL FUNCTIONS
+ */
+HAL_StatusTypeDef MCP7940M_ReadRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data)
+{
+    return MCP7940M_ReadRegisters(p_mcp7940m, reg, p_data, 1);
+}
+
+HAL_StatusTypeDef MCP7940M_WriteRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t data)
+{
+    return MCP7940M_WriteRegisters(p_mcp7940m, reg, &data, 1);
+}
+
+/**
+ * @brief  Reads consecutive registers in one I2C transaction.
+ * @note   The MCP7940M auto-increments the register pointer, so this costs a
+ *         single address+register+restart sequence regardless of length.
+ *         A failed transfer is retried as set by MCP7940M_SetRetries.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg First register to read.
+ * @param  p_data Buffer receiving length bytes.
+ * @param  length Number of registers to read.
+ * @retval HAL status of the last attempt.
+ */
+HAL_StatusTypeDef MCP7940M_ReadRegisters(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data, uint16_t length)
+{
+    HAL_StatusTypeDef status;
+    uint8_t attempt = 0;
+    MCP7940M_STATS_BEGIN(start);
+
+    for (;;)
+    {
+        status = MCP7940M_Transfer(p_mcp7940m, 0, reg, p_data, NULL, length);
+        if (status == HAL_OK || attempt == p_mcp7940m->retries)
+        {
+            break;
+        }
+        MCP7940M_RetryBackoff(p_mcp7940m, attempt++);
+    }
+
+    MCP7940M_STATS_END(p_mcp7940m, MCP7940M_STATS_READ, start);
+    return status;
+}
+
+/**
+ * @brief  Writes consecutive registers in one I2C transaction.
+ * @note   A failed transfer is retried as set by MCP7940M_SetRetries.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg First register to write.
+ * @param  p_data length bytes to write.
+ * @param  length Number of registers to write.
+ * @retval HAL status of the last attempt.
+ */
+HAL_StatusTypeDef MCP7940M_WriteRegisters(MCP7940M *p_mcp7940m, uint8_t reg, const uint8_t *p_data, uint16_t length)
+{
+    HAL_StatusTypeDef status;
+    uint8_t attempt = 0;
+    MCP7940M_STATS_BEGIN(start);
+
+    for (;;)
+    {
+        status = MCP7940M_Transfer(p_mcp7940m, 1, reg, NULL, p_data, length);
+        if (status == HAL_OK || attempt == p_mcp7940m->retries)
+        {
+            break;
+        }
+        MCP7940M_RetryBackoff(p_mcp7940m, attempt++);
+    }
+
+    MCP7940M_STATS_END(p_mcp7940m, MCP7940M_STATS_WRITE, start);
+    return status;
+}
+
+/**
+ * @brief  Runs one blocking transfer under the bus lock.
+ * @note   Updates the shadow cache on success and recovers the bus after a
+ *         timeout.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  write 1 to write p_write, 0 to read into p_read.
+ * @param  reg First register.
+ * @param  p_read Buffer of a read.
+ * @param  p_write Data of a write.
+ * @param  length Number of registers.
+ * @retval HAL status of the transfer.
+ */
+static HAL_StatusTypeDef MCP7940M_Transfer(MCP7940M *p_mcp7940m, uint8_t write, uint8_t reg, uint8_t *p_read, const uint8_t *p_write, uint16_t length)
+{
+    uint32_t timeout = MCP7940M_TransferTimeout(p_mcp7940m, length);
+    HAL_StatusTypeDef status;
+
+    if (p_mcp7940m->busLock != NULL)
+    {
+        p_mcp7940m->busLock(p_mcp7940m->lockContext);
+    }
+    MCP7940M_BusPowerUp(p_mcp7940m);
+    MCP7940M_STATS_ADD(p_mcp7940m, transactions, 1);
+    if (write)
+    {
+        MCP7940M_STATS_ADD(p_mcp7940m, bytesWritten, length);
+        status = p_mcp7940m->transport->write(p_mcp7940m->busContext, MCP7940M_I2C_ADDRESS, reg, p_write, length, timeout);
+    }
+    else
+    {
+        MCP7940M_STATS_ADD(p_mcp7940m, bytesRead, length);
+        status = p_mcp7940m->transport->read(p_mcp7940m->busContext, MCP7940M_I2C_ADDRESS, reg, p_read, length, timeout);
+    }
+    if (status == HAL_OK)
+    {
+        MCP7940M_ShadowUpdate(p_mcp7940m, reg, write ? p_write : p_read, length, write);
+    }
+    else
+    {
+        MCP7940M_StatsStatus(p_mcp7940m, status);
+        if (status == HAL_TIMEOUT)
+        {
+            MCP7940M_RecoverBus(p_mcp7940m);
+        }
+    }
+    MCP7940M_BusPowerDown(p_mcp7940m);
+    if (p_mcp7940m->busUnlock != NULL)
+    {
+        p_mcp7940m->busUnlock(p_mcp7940m->lockContext);
+    }
+    return status;
+}
+
+/**
+ * @brief  Waits before a retry, doubling the wait with every attempt.
+ * @note   The bus lock is not held, so other users get the bus meanwhile.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  attempt Retries done so far.
+ */
+static void MCP7940M_RetryBackoff(MCP7940M *p_mcp7940m, uint8_t attempt)
+{
+    uint32_t wait = (uint32_t)p_mcp7940m->retryBackoff << (attempt < 8 ? attempt : 8);
+    uint32_t start = p_mcp7940m->transport->getTick(p_mcp7940m->busContext);
+
+    MCP7940M_STATS_ADD(p_mcp7940m, retries, 1);
+    while ((p_mcp7940m->transport->getTick(p_mcp7940m->busContext) - start) < wait)
+    {
+    }
+}
+
+/**
+ * @brief  Clears ST and waits for the oscillator to report it has stopped.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL_OK once OSCRUN reads back cleared, HAL_TIMEOUT if it did not
+ *         within MCP7940M_OSCRUN_TIMEOUT ms, otherwise the transfer status.
+ */
+static HAL_StatusTypeDef MCP7940M_StopOscillator(MCP7940M *p_mcp7940m)
+{
+    uint32_t start;
+    uint8_t wkday;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, 0);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    start = p_mcp7940m->transport->getTick(p_mcp7940m->busContext);
+    do
+    {
+        status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, &wkday);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        if ((wkday & MCP7940M_RTCWKDAY_OSCRUN) == 0)
+        {
+            return HAL_OK;
+        }
+    } while ((p_mcp7940m->transport->getTick(p_mcp7940m->busContext) - start) < MCP7940M_OSCRUN_TIMEOUT);
+
+    return HAL_TIMEOUT;
+}
+
+/**
+ * @brief  Decodes a raw RTCSEC..RTCYEAR block into the MCP7940M struct.
+ * @param  p_mcp7940m Pointer to the MCP7940M structure to update.
+ * @param  p_regs MCP7940M_TIME_REG_COUNT raw register bytes.
+ */
+static void MCP7940M_DecodeTimeRegisters(MCP7940M *p_mcp7940m, const uint8_t *p_regs)
+{
+    MCP7940M_Time time;
+
+    MCP7940M_DecodeTimeBlock(p_regs, &time);
+    p_mcp7940m->seconds = time.seconds;
+    p_mcp7940m->minutes = time.minutes;
+    p_mcp7940m->hours = time.hours;
+    p_mcp7940m->weekday = time.weekday;
+    p_mcp7940m->date = time.date;
+    p_mcp7940m->month = time.month;
+    p_mcp7940m->year = time.year;
+    p_mcp7940m->twelveHour = (p_regs[2] & MCP7940M_RTCHOUR_12_24) ? 1 : 0;
+}
+
+/**
+ * @brief  Encodes the MCP7940M struct into a raw RTCSEC..RTCYEAR block.
+ * @note   ST is set so that the burst restarts the oscillator, the hour format
+ *         of the chip is kept and the read-only OSCRUN/LP bits are written 0.
+ * @param  p_mcp7940m Pointer to the MCP7940M structure holding the time.
+ * @param  p_regs Buffer receiving MCP7940M_TIME_REG_COUNT register bytes.
+ */
+static void MCP7940M_EncodeTimeRegisters(const MCP7940M *p_mcp7940m, uint8_t *p_regs)
+{
+    p_regs[0] = MCP7940M_BCDEncode(p_mcp7940m->seconds) | MCP7940M_RTCSEC_ST; // Set the ST bit.
+    p_regs[1] = MCP7940M_BCDEncode(p_mcp7940m->minutes);
+    p_regs[2] = MCP7940M_EncodeHours(p_mcp7940m->hours, p_mcp7940m->twelveHour);
+    p_regs[3] = MCP7940M_EncodeWeekday(p_mcp7940m->weekday);
+    p_regs[4] = MCP7940M_BCDEncode(p_mcp7940m->date);
+    p_regs[5] = MCP7940M_BCDEncode(p_mcp7940m->month) & ~MCP7940M_RTCMTH_LP; // Clear the LP bit.
+    p_regs[6] = MCP7940M_BCDEncode(p_mcp7940m->year);
+}
+
+/**
+ * @brief  Reads RTCSEC..RTCYEAR as one consistent burst.
+ * @note   If the seconds read 59 the minute may have rolled over during the
+ *         burst, so RTCSEC is read again and the burst repeated if it moved on.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  p_regs Receives MCP7940M_TIME_REG_COUNT register bytes.
+ * @retval HAL status of the reads.
+ */
+static HAL_StatusTypeDef MCP7940M_ReadTimeBlock(MCP7940M *p_mcp7940m, uint8_t *p_regs)
+{
+    uint8_t check;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, p_regs, MCP7940M_TIME_REG_COUNT);
+    if (status == HAL_OK && (p_regs[0] & 0b01111111) == 0x59)
+    {
+        status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, &check);
+        if (status == HAL_OK && check != p_regs[0])
+        {
+            status = MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, p_regs, MCP7940M_TIME_REG_COUNT);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief  Copies the time fields of the MCP7940M struct.
+ * @param  p_mcp7940m Pointer to the MCP7940M structure holding the time.
+ * @param  p_time Receives the time.
+ */
+static void MCP7940M_GetTimeFields(const MCP7940M *p_mcp7940m, MCP7940M_Time *p_time)
+{
+    p_time->seconds = p_mcp7940m->seconds;
+    p_time->minutes = p_mcp7940m->minutes;
+    p_time->hours = p_mcp7940m->hours;
+    p_time->weekday = p_mcp7940m->weekday;
+    p_time->date = p_mcp7940m->date;
+    p_time->month = p_mcp7940m->month;
+    p_time->year = p_mcp7940m->year;
+}
+
+#ifndef MCP7940M_NO_HAL
 /*
- * INITIALISATION
+ * HAL TRANSPORT
+ */
+static HAL_StatusTypeDef MCP7940M_HAL_Read(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    return HAL_I2C_Mem_Read((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, p_data, length, timeout);
+}
+
+static HAL_StatusTypeDef MCP7940M_HAL_Write(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    return HAL_I2C_Mem_Write((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, (uint8_t *)p_data, length, timeout);
+}
+
+static HAL_StatusTypeDef MCP7940M_HAL_ReadAsync(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint8_t dma)
+{
+    if (dma)
+    {
+        return HAL_I2C_Mem_Read_DMA((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, p_data, length);
+    }
+    return HAL_I2C_Mem_Read_IT((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, p_data, length);
+}
+
+static HAL_StatusTypeDef MCP7940M_HAL_WriteAsync(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint8_t dma)
+{
+    if (dma)
+    {
+        return HAL_I2C_Mem_Write_DMA((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, (uint8_t *)p_data, length);
+    }
+    return HAL_I2C_Mem_Write_IT((I2C_HandleTypeDef *)p_context, address, reg, I2C_MEMADD_SIZE_8BIT, (uint8_t *)p_data, length);
+}
+
+static uint32_t MCP7940M_HAL_GetTick(void *p_context)
+{
+    (void)p_context;
+    return HAL_GetTick();
+}
+
+static void MCP7940M_HAL_RecoveryDelay(void)
+{
+    volatile uint32_t i;
+
+    for (i = 0; i < MCP7940M_RECOVERY_DELAY; i++)
+    {
+    }
+}
+
+/**
+ * @brief  Frees a bus held by a slave and re-initializes the I2C peripheral.
+ * @note   The pins are switched to open drain GPIO and SCL is clocked up to
+ *         nine times until the slave releases SDA, followed by a STOP. The
+ *         peripheral is then reset and HAL_I2C_Init (through HAL_I2C_MspInit)
+ *         restores the pin alternate functions.
+ * @param  p_context Pointer to a MCP7940M_HAL_BusPins.
+ * @retval HAL_OK, HAL_ERROR if SDA is still held low.
  */
+HAL_StatusTypeDef MCP7940M_HAL_BusRecover(void *p_context)
+{
+    MCP7940M_HAL_BusPins *p_pins = (MCP7940M_HAL_BusPins *)p_context;
+    GPIO_InitTypeDef gpio = {0};
+    GPIO_PinState sda;
+    uint8_t i;
+
+    HAL_I2C_DeInit(p_pins->i2cHandle);
 
+    gpio.Mode = GPIO_MODE_OUTPUT_OD;
+    gpio.Pull = GPIO_NOPULL;
+    gpio.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_WritePin(p_pins->sclPort, p_pins->sclPin, GPIO_PIN_SET);
+    HAL_GPIO_WritePin(p_pins->sdaPort, p_pins->sdaPin, GPIO_PIN_SET);
+    gpio.Pin = p_pins->sclPin;
+    HAL_GPIO_Init(p_pins->sclPort, &gpio);
+    gpio.Pin = p_pins->sdaPin;
+    HAL_GPIO_Init(p_pins->sdaPort, &gpio);
+
+    for (i = 0; i < 9 && HAL_GPIO_ReadPin(p_pins->sdaPort, p_pins->sdaPin) == GPIO_PIN_RESET; i++)
+    {
+        HAL_GPIO_WritePin(p_pins->sclPort, p_pins->sclPin, GPIO_PIN_RESET);
+        MCP7940M_HAL_RecoveryDelay();
+        HAL_GPIO_WritePin(p_pins->sclPort, p_pins->sclPin, GPIO_PIN_SET);
+        MCP7940M_HAL_RecoveryDelay();
+    }
+
+    /* STOP: SDA rises while SCL is high. */
+    HAL_GPIO_WritePin(p_pins->sdaPort, p_pins->sdaPin, GPIO_PIN_RESET);
+    MCP7940M_HAL_RecoveryDelay();
+    HAL_GPIO_WritePin(p_pins->sdaPort, p_pins->sdaPin, GPIO_PIN_SET);
+    MCP7940M_HAL_RecoveryDelay();
+    sda = HAL_GPIO_ReadPin(p_pins->sdaPort, p_pins->sdaPin);
+
+    /* Clear a BUSY flag latched by the peripheral during the fault. */
+    p_pins->i2cHandle->Instance->CR1 |= I2C_CR1_SWRST;
+    p_pins->i2cHandle->Instance->CR1 &= ~I2C_CR1_SWRST;
+    if (HAL_I2C_Init(p_pins->i2cHandle) != HAL_OK)
+    {
+        return HAL_ERROR;
+    }
+    return (sda == GPIO_PIN_SET) ? HAL_OK : HAL_ERROR;
+}
+
+/* Transport over the STM32 HAL I2C driver, the bus context is the I2C_HandleTypeDef. */
 /**
- * @brief  Initializes the MCP7940M
- * @param  p_mcp7940m Pointer to a MCP7940M structure that will contain
- *                  our MCP7940M data.
- * @param  p_i2cHandle Pointer to our I2C handle
+ * @brief  Enables the peripheral clock of an I2C handle, a MCP7940M_SetBusPower hook.
+ * @param  p_context The I2C_HandleTypeDef of the bus.
  */
-void MCP7940M_Init(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle)
+void MCP7940M_HAL_ClockEnable(void *p_context)
 {
-    p_mcp7940m->i2cHandle = p_i2cHandle;
+    I2C_TypeDef *p_instance = ((I2C_HandleTypeDef *)p_context)->Instance;
 
-    p_mcp7940m->seconds = 0;
-    p_mcp7940m->minutes = 0;
-    p_mcp7940m->hours = 0;
-    p_mcp7940m->weekday = MONDAY;
-    p_mcp7940m->date = 1;
-    p_mcp7940m->month = 1;
-    p_mcp7940m->year = 0;
+    if (p_instance == I2C1)
+    {
+        __HAL_RCC_I2C1_CLK_ENABLE();
+    }
+    else if (p_instance == I2C2)
+    {
+        __HAL_RCC_I2C2_CLK_ENABLE();
+    }
+#ifdef I2C3
+    else if (p_instance == I2C3)
+    {
+        __HAL_RCC_I2C3_CLK_ENABLE();
+    }
+#endif
+}
+
+/**
+ * @brief  Gates the peripheral clock of an I2C handle, a MCP7940M_SetBusPower hook.
+ * @note   The peripheral keeps its configuration while the clock is gated.
+ * @param  p_context The I2C_HandleTypeDef of the bus.
+ */
+void MCP7940M_HAL_ClockDisable(void *p_context)
+{
+    I2C_TypeDef *p_instance = ((I2C_HandleTypeDef *)p_context)->Instance;
+
+    if (p_instance == I2C1)
+    {
+        __HAL_RCC_I2C1_CLK_DISABLE();
+    }
+    else if (p_instance == I2C2)
+    {
+        __HAL_RCC_I2C2_CLK_DISABLE();
+    }
+#ifdef I2C3
+    else if (p_instance == I2C3)
+    {
+        __HAL_RCC_I2C3_CLK_DISABLE();
+    }
+#endif
+}
+
+const MCP7940M_Transport MCP7940M_HAL_Transport = {
+    .read = MCP7940M_HAL_Read,
+    .write = MCP7940M_HAL_Write,
+    .readAsync = MCP7940M_HAL_ReadAsync,
+    .writeAsync = MCP7940M_HAL_WriteAsync,
+    .getTick = MCP7940M_HAL_GetTick,
+};
+#endif /* MCP7940M_NO_HAL */
 
-    /* Enable Oscillator */
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, 1 << 7);
+/*
+ * SHADOW REGISTER CACHE
+ */
+
+/**
+ * @brief  Loads the whole register map into the shadow cache with one burst.
+ * @note   Staged (dirty) registers keep their staged value.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL status of the burst read.
+ */
+HAL_StatusTypeDef MCP7940M_LoadCache(MCP7940M *p_mcp7940m)
+{
+    uint8_t regs[MCP7940M_REG_MAP_SIZE];
+
+    return MCP7940M_ReadRegisters(p_mcp7940m, MCP7940M_REG_RTCSEC, regs, MCP7940M_REG_MAP_SIZE);
 }
 
 /**
- * @brief  Gets the time from the MCP7940M
- * @param  p_mcp7940m Pointer to a MCP7940M structure that will
- *                    store our MCP7940M data.
- * @retval HAL_OK if success, HAL_ERROR if failed.
+ * @brief  Forgets every cached and staged register value.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
  */
-HAL_StatusTypeDef MCP7940M_GetTime(MCP7940M *p_mcp7940m)
+void MCP7940M_InvalidateCache(MCP7940M *p_mcp7940m)
+{
+    p_mcp7940m->shadowValid = 0;
+    p_mcp7940m->shadowDirty = 0;
+}
+
+/**
+ * @brief  Reads a register through the shadow cache.
+ * @note   The timekeeping registers keep counting on the chip, so their cached
+ *         value is only as fresh as the last transfer that touched them.
+ *         Staged registers always return the staged value.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg Register in the range RTCSEC..ALM1MTH.
+ * @param  p_data Receives the register value.
+ * @param  allowCached 1 to serve a known value without bus access, 0 to
+ *                     always read the chip.
+ * @retval HAL_OK if success, HAL_ERROR if reg is outside the map, otherwise
+ *         the HAL status of the read.
+ */
+HAL_StatusTypeDef MCP7940M_CacheRead(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data, uint8_t allowCached)
 {
-    MCP7940M_ReadSeconds(p_mcp7940m);
-    MCP7940M_ReadMinutes(p_mcp7940m);
-    MCP7940M_ReadHours(p_mcp7940m);
-    MCP7940M_ReadWeekday(p_mcp7940m);
-    MCP7940M_ReadDate(p_mcp7940m);
-    MCP7940M_ReadMonth(p_mcp7940m);
-    MCP7940M_ReadYear(p_mcp7940m);
+    uint32_t bit;
+
+    if (reg >= MCP7940M_REG_MAP_SIZE)
+    {
+        return HAL_ERROR;
+    }
+
+    bit = 1UL << reg;
+    if ((p_mcp7940m->shadowDirty & bit) || (allowCached && (p_mcp7940m->shadowValid & bit)))
+    {
+        *p_data = p_mcp7940m->shadow[reg];
+        return HAL_OK;
+    }
+    return MCP7940M_ReadRegister(p_mcp7940m, reg, p_data);
+}
+
+/**
+ * @brief  Stages a register value in the shadow cache.
+ * @note   Nothing is sent until MCP7940M_Flush. Writing the value the chip is
+ *         already known to hold does not mark the register dirty.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg Register in the range RTCSEC..ALM1MTH.
+ * @param  data New register value.
+ * @retval HAL_OK if success, HAL_ERROR if reg is outside the map.
+ */
+HAL_StatusTypeDef MCP7940M_CacheWrite(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t data)
+{
+    uint32_t bit;
+
+    if (reg >= MCP7940M_REG_MAP_SIZE)
+    {
+        return HAL_ERROR;
+    }
+
+    bit = 1UL << reg;
+    if ((p_mcp7940m->shadowValid & bit) && !(p_mcp7940m->shadowDirty & bit) && p_mcp7940m->shadow[reg] == data)
+    {
+        return HAL_OK;
+    }
+    p_mcp7940m->shadow[reg] = data;
+    p_mcp7940m->shadowDirty |= bit;
     return HAL_OK;
 }
 
 /**
- * @brief  Writes the time to the MCP7940M
- * @param  p_mcp7940m Pointer to a MCP7940M structure that contains
- *                  the data we ant to write to our MCP7940M.
- * @retval HAL_OK if success, HAL_ERROR if failed.
+ * @brief  Stages the time fields of the struct in the shadow cache.
+ * @note   Only registers that differ from the last known chip contents become
+ *         dirty, so after a MCP7940M_GetTime a following MCP7940M_Flush only
+ *         writes the fields that were changed. The bits outside the time
+ *         fields (ST, OSCRUN, LP) are taken from the shadow when it is known,
+ *         so they never make a register dirty. Unlike MCP7940M_SetTime the
+ *         oscillator keeps running.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL_OK
  */
-HAL_StatusTypeDef MCP7940M_SetTime(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_StageTime(MCP7940M *p_mcp7940m)
 {
-    MCP7940M_WriteSeconds(p_mcp7940m);
-    MCP7940M_WriteMinutes(p_mcp7940m);
-    MCP7940M_WriteHours(p_mcp7940m);
-    MCP7940M_WriteWeekday(p_mcp7940m);
-    MCP7940M_WriteDate(p_mcp7940m);
-    MCP7940M_WriteMonth(p_mcp7940m);
-    MCP7940M_WriteYear(p_mcp7940m);
+    uint8_t regs[MCP7940M_TIME_REG_COUNT];
+    uint8_t reg;
+    uint8_t i;
+
+    MCP7940M_EncodeTimeRegisters(p_mcp7940m, regs);
+    for (i = 0; i < MCP7940M_TIME_REG_COUNT; i++)
+    {
+        reg = MCP7940M_REG_RTCSEC + i;
+        if (p_mcp7940m->shadowValid & (1UL << reg))
+        {
+            regs[i] = (regs[i] & MCP7940M_FieldMask[i]) | (p_mcp7940m->shadow[reg] & (uint8_t)~MCP7940M_FieldMask[i]);
+        }
+        MCP7940M_CacheWrite(p_mcp7940m, reg, regs[i]);
+    }
     return HAL_OK;
 }
 
-/*
- * LOW-LEVEL FUNCTIONS
+/**
+ * @brief  Writes all staged registers to the chip.
+ * @note   Each run of consecutive dirty registers is sent as one burst.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @retval HAL_OK if everything was written, otherwise the HAL status of the
+ *         first failing burst. Registers not yet written stay dirty.
  */
-HAL_StatusTypeDef MCP7940M_ReadRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data)
+HAL_StatusTypeDef MCP7940M_Flush(MCP7940M *p_mcp7940m)
 {
-    return HAL_I2C_Mem_Read(p_mcp7940m->i2cHandle, MCP7940M_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, p_data, 1, 1000);
+    HAL_StatusTypeDef status;
+    uint8_t first;
+    uint8_t last;
+
+    for (first = 0; first < MCP7940M_REG_MAP_SIZE; first++)
+    {
+        if (!(p_mcp7940m->shadowDirty & (1UL << first)))
+        {
+            continue;
+        }
+
+        last = first;
+        while (last + 1 < MCP7940M_REG_MAP_SIZE && (p_mcp7940m->shadowDirty & (1UL << (last + 1))))
+        {
+            last++;
+        }
+
+        /* A successful write clears the dirty bits through the write-through path. */
+        status = MCP7940M_WriteRegisters(p_mcp7940m, first, &p_mcp7940m->shadow[first], last - first + 1);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        first = last;
+    }
+    return HAL_OK;
 }
 
-HAL_StatusTypeDef MCP7940M_WriteRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t data)
+/**
+ * @brief  Changes some bits of a register with a single write.
+ * @note   The current value comes from the shadow cache if known, so a known
+ *         register costs one write and no read. Nothing is written when the
+ *         bits already hold the requested value. The counting bits of
+ *         RTCSEC..RTCYEAR move on after they were cached, keep them out of
+ *         mask and only change control bits of those registers.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg Register in the range RTCSEC..ALM1MTH.
+ * @param  mask Bits to change.
+ * @param  value New value of the bits in mask.
+ * @retval HAL status of the read or write.
+ */
+HAL_StatusTypeDef MCP7940M_UpdateRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t mask, uint8_t value)
+{
+    uint8_t data;
+    uint8_t modified;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_CacheRead(p_mcp7940m, reg, &data, 1);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    modified = (data & ~mask) | (value & mask);
+    if (modified == data && !(p_mcp7940m->shadowDirty & (1UL << reg)))
+    {
+        return HAL_OK;
+    }
+    return MCP7940M_WriteRegister(p_mcp7940m, reg, modified);
+}
+
+/**
+ * @brief  Mirrors a completed transfer into the shadow cache.
+ * @note   Reads never overwrite a staged value.
+ * @param  p_mcp7940m Pointer to our MCP7940M structure.
+ * @param  reg First register of the transfer.
+ * @param  p_data Transferred bytes.
+ * @param  length Number of registers transferred.
+ * @param  written 1 if the bytes were written to the chip, 0 if read from it.
+ */
+static void MCP7940M_ShadowUpdate(MCP7940M *p_mcp7940m, uint8_t reg, const uint8_t *p_data, uint16_t length, uint8_t written)
 {
-    return HAL_I2C_Mem_Write(p_mcp7940m->i2cHandle, MCP7940M_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, &data, 1, 1000);
+    uint32_t bit;
+
+    for (; length > 0 && reg < MCP7940M_REG_MAP_SIZE; length--, reg++, p_data++)
+    {
+        bit = 1UL << reg;
+        if (!written && (p_mcp7940m->shadowDirty & bit))
+        {
+            continue;
+        }
+        p_mcp7940m->shadow[reg] = *p_data;
+        p_mcp7940m->shadowValid |= bit;
+        p_mcp7940m->shadowDirty &= ~bit;
+    }
 }
 
-void MCP7940M_ReadSeconds(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadSeconds(MCP7940M *p_mcp7940m)
 {
     uint8_t seconds;
     uint8_t bcdSeconds;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, &bcdSeconds);
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, &bcdSeconds);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
     bcdSeconds &= 0b01111111; // Discard the ST bit.
     seconds = BCDToBinary(bcdSeconds);
     p_mcp7940m->seconds = seconds;
+    return HAL_OK;
 }
 
-void MCP7940M_ReadMinutes(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadMinutes(MCP7940M *p_mcp7940m)
 {
     uint8_t minutes;
     uint8_t bcdMinutes;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCMIN, &bcdMinutes);
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCMIN, &bcdMinutes);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
     minutes = BCDToBinary(bcdMinutes);
     p_mcp7940m->minutes = minutes;
+    return HAL_OK;
 }
 
-void MCP7940M_ReadHours(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadHours(MCP7940M *p_mcp7940m)
 {
-    uint8_t hours;
     uint8_t bcdHours;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCHOUR, &bcdHours);
-    bcdHours &= 0b00111111; // Discard the 12/24 bit.
-    hours = BCDToBinary(bcdHours);
-    p_mcp7940m->hours = hours;
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCHOUR, &bcdHours);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
+    p_mcp7940m->hours = MCP7940M_DecodeHours(bcdHours); // 12 hour format is converted.
+    p_mcp7940m->twelveHour = (bcdHours & MCP7940M_RTCHOUR_12_24) ? 1 : 0;
+    return HAL_OK;
 }
 
-void MCP7940M_ReadWeekday(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadWeekday(MCP7940M *p_mcp7940m)
 {
     uint8_t weekday;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, &weekday);
-    weekday &= 0b00000111; // Discard the OSCRUN bit.
-    p_mcp7940m->weekday = weekday;
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, &weekday);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
+    p_mcp7940m->weekday = MCP7940M_DecodeWeekday(weekday); // Discards the OSCRUN bit.
+    return HAL_OK;
 }
 
-void MCP7940M_ReadDate(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadDate(MCP7940M *p_mcp7940m)
 {
     uint8_t date;
     uint8_t bcdDate;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCDATE, &bcdDate);
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCDATE, &bcdDate);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
     date = BCDToBinary(bcdDate);
     p_mcp7940m->date = date;
+    return HAL_OK;
 }
 
-void MCP7940M_ReadMonth(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadMonth(MCP7940M *p_mcp7940m)
 {
     uint8_t month;
     uint8_t bcdMonth;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCMTH, &bcdMonth);
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCMTH, &bcdMonth);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
     bcdMonth &= 0b00011111; // Discard the LP bit.
     month = BCDToBinary(bcdMonth);
     p_mcp7940m->month = month;
+    return HAL_OK;
 }
 
-void MCP7940M_ReadYear(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_ReadYear(MCP7940M *p_mcp7940m)
 {
     uint8_t year;
     uint8_t bcdYear;
-    MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCYEAR, &bcdYear);
+    HAL_StatusTypeDef status = MCP7940M_ReadRegister(p_mcp7940m, MCP7940M_REG_RTCYEAR, &bcdYear);
+    if (status != HAL_OK)
+    {
+        return status; // Leave the field as it was.
+    }
     year = BCDToBinary(bcdYear);
     p_mcp7940m->year = year;
+    return HAL_OK;
 }
 
-void MCP7940M_WriteSeconds(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteSeconds(MCP7940M *p_mcp7940m)
 {
     uint8_t bcdSeconds = binaryToBCD(p_mcp7940m->seconds);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, bcdSeconds | 1 << 7); // Set the ST bit.
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCSEC, bcdSeconds | 1 << 7); // Set the ST bit.
 }
 
-void MCP7940M_WriteMinutes(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteMinutes(MCP7940M *p_mcp7940m)
 {
     uint8_t bcdMinutes = binaryToBCD(p_mcp7940m->minutes);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCMIN, bcdMinutes);
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCMIN, bcdMinutes);
 }
 
-void MCP7940M_WriteHours(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteHours(MCP7940M *p_mcp7940m)
 {
-    uint8_t bcdHours = binaryToBCD(p_mcp7940m->hours);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCHOUR, bcdHours & ~(1 << 6)); // Clear the 12/24 bit.
+    uint8_t bcdHours = MCP7940M_EncodeHours(p_mcp7940m->hours, p_mcp7940m->twelveHour); // Keep the 12/24 bit.
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCHOUR, bcdHours);
 }
 
-void MCP7940M_WriteWeekday(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteWeekday(MCP7940M *p_mcp7940m)
 {
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, p_mcp7940m->weekday);
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCWKDAY, MCP7940M_EncodeWeekday(p_mcp7940m->weekday));
 }
 
-void MCP7940M_WriteDate(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteDate(MCP7940M *p_mcp7940m)
 {
     uint8_t bcdDate = binaryToBCD(p_mcp7940m->date);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCDATE, bcdDate);
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCDATE, bcdDate);
 }
 
-void MCP7940M_WriteMonth(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteMonth(MCP7940M *p_mcp7940m)
 {
     uint8_t bcdMonth = binaryToBCD(p_mcp7940m->month);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCMTH, bcdMonth & ~(1 << 5)); // Clear the LP bit.
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCMTH, bcdMonth); // LP is read only.
 }
 
-void MCP7940M_WriteYear(MCP7940M *p_mcp7940m)
+HAL_StatusTypeDef MCP7940M_WriteYear(MCP7940M *p_mcp7940m)
 {
     uint8_t bcdYear = binaryToBCD(p_mcp7940m->year);
-    MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCYEAR, bcdYear);
+    return MCP7940M_WriteRegister(p_mcp7940m, MCP7940M_REG_RTCYEAR, bcdYear);
 }
 
 uint8_t BCDToBinary(uint8_t bcd)
 {
-    uint8_t tens = bcd >> 4;
-    uint8_t ones = bcd & 0b00001111;
-    return tens * 10 + ones;
+    return MCP7940M_BCDDecode(bcd);
 }
 
 uint8_t binaryToBCD(uint8_t binary)
 {
-    uint8_t tens = binary / 10;
-    uint8_t ones = binary % 10;
-    return (tens << 4) | ones;
+    return MCP7940M_BCDEncode(binary);
+}
+
+/*
+ * Four byte lanes per 32 bit word. Neither kernel carries between lanes
+ * (a decoded lane loses 6 * tens <= 54, an encoded lane gains at most 54 on
+ * a value <= 99), so plain word arithmetic gives the same result as the
+ * Cortex-M4 __UADD8/__USUB8 byte instructions without depending on them.
+ */
+static inline uint32_t MCP7940M_BCDDecodeWord(uint32_t bcd)
+{
+    return bcd - ((bcd >> 4) & 0x0F0F0F0FUL) * 6;
+}
+
+static inline uint32_t MCP7940M_BCDEncodeWord(uint32_t binary)
+{
+    /* Divide by 10 as (x * 205) >> 11 in two 16 bit lanes per multiply. */
+    uint32_t evenTens = (((binary & 0x00FF00FFUL) * 205) >> 11) & 0x001F001FUL;
+    uint32_t oddTens = ((((binary >> 8) & 0x00FF00FFUL) * 205) >> 11) & 0x001F001FUL;
+    return binary + (evenTens | (oddTens << 8)) * 6;
+}
+
+/**
+ * @brief  Decodes a block of BCD bytes.
+ * @param  p_bcd Packed BCD input, values 00..99.
+ * @param  p_binary Receives length binary values, may equal p_bcd.
+ * @param  length Number of bytes.
+ */
+void MCP7940M_BCDDecodeBlock(const uint8_t *p_bcd, uint8_t *p_binary, uint32_t length)
+{
+    uint32_t word;
+
+    for (; length >= 4; length -= 4, p_bcd += 4, p_binary += 4)
+    {
+        memcpy(&word, p_bcd, 4);
+        word = MCP7940M_BCDDecodeWord(word);
+        memcpy(p_binary, &word, 4);
+    }
+    for (; length > 0; length--)
+    {
+        *p_binary++ = MCP7940M_BCDDecode(*p_bcd++);
+    }
+}
+
+/**
+ * @brief  Encodes a block of binary values as BCD.
+ * @param  p_binary Binary input, values 0..99.
+ * @param  p_bcd Receives length BCD bytes, may equal p_binary.
+ * @param  length Number of bytes.
+ */
+void MCP7940M_BCDEncodeBlock(const uint8_t *p_binary, uint8_t *p_bcd, uint32_t length)
+{
+    uint32_t word;
+
+    for (; length >= 4; length -= 4, p_binary += 4, p_bcd += 4)
+    {
+        memcpy(&word, p_binary, 4);
+        word = MCP7940M_BCDEncodeWord(word);
+        memcpy(p_bcd, &word, 4);
+    }
+    for (; length > 0; length--)
+    {
+        *p_bcd++ = MCP7940M_BCDEncode(*p_binary++);
+    }
+}
+
+/**
+ * @brief  Decodes a raw RTCSEC..RTCYEAR block in two word operations.
+ * @note   Control and status bits (ST, 12/24, OSCRUN, LP) are masked off.
+ *         Only MCP7940M_TIME_REG_COUNT bytes of p_regs are read.
+ * @param  p_regs Raw register bytes.
+ * @param  p_time Receives the decoded time.
+ */
+void MCP7940M_DecodeTimeBlock(const uint8_t *p_regs, MCP7940M_Time *p_time)
+{
+    uint8_t binary[MCP7940M_RAW_BUFFER_SIZE];
+    uint32_t low;
+    uint32_t high = 0;
+
+    memcpy(&low, p_regs, 4);
+    memcpy(&high, p_regs + 4, MCP7940M_TIME_REG_COUNT - 4);
+
+    /* Byte lane masks, lowest address in the lowest lane. */
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    low = MCP7940M_BCDDecodeWord(low & 0x7F7F3F07UL);
+    high = MCP7940M_BCDDecodeWord(high & 0x3F1FFF00UL);
+#else
+    low = MCP7940M_BCDDecodeWord(low & 0x073F7F7FUL);
+    high = MCP7940M_BCDDecodeWord(high & 0x00FF1F3FUL);
+#endif
+    memcpy(binary, &low, 4);
+    memcpy(binary + 4, &high, 4);
+
+    p_time->seconds = binary[0];
+    p_time->minutes = binary[1];
+    p_time->hours = MCP7940M_DecodeHours(p_regs[2]);
+    p_time->weekday = MCP7940M_DecodeWeekday(p_regs[3]);
+    p_time->date = binary[4];
+    p_time->month = binary[5];
+    p_time->year = binary[6];
+}
+
+/**
+ * @brief  Advances a time by one second, carrying into the calendar fields.
+ * @note   Years 00..99 are 2000..2099, so every year divisible by 4 is leap.
+ * @param  p_time The time to advance.
+ */
+void MCP7940M_IncrementTime(MCP7940M_Time *p_time)
+{
+    uint8_t days;
+
+    if (++p_time->seconds < 60)
+    {
+        return;
+    }
+    p_time->seconds = 0;
+    if (++p_time->minutes < 60)
+    {
+        return;
+    }
+    p_time->minutes = 0;
+    if (++p_time->hours < 24)
+    {
+        return;
+    }
+    p_time->hours = 0;
+    p_time->weekday = (p_time->weekday == SUNDAY) ? MONDAY : (Weekday)(p_time->weekday + 1);
+
+    days = (p_time->month >= 1 && p_time->month <= 12) ? MCP7940M_DaysInMonth[p_time->month - 1] : 31; // Corrupted month: carry on.
+    if (p_time->month == 2 && (p_time->year & 0b11) == 0)
+    {
+        days++;
+    }
+    if (++p_time->date <= days)
+    {
+        return;
+    }
+    p_time->date = 1;
+    if (++p_time->month <= 12)
+    {
+        return;
+    }
+    p_time->month = 1;
+    p_time->year = (p_time->year + 1) % 100;
+}
+
+/**
+ * @brief  Publishes a new time to a snapshot.
+ * @note   Only one context may publish to a snapshot. The buffer readers are
+ *         not using is written before sequence moves on, so a reader never
+ *         waits for the writer.
+ * @param  p_snapshot The snapshot to update.
+ * @param  p_time The new time.
+ * @param  timer Timer value stored with the time.
+ */
+void MCP7940M_SnapshotPublish(MCP7940M_Snapshot *p_snapshot, const MCP7940M_Time *p_time, uint32_t timer)
+{
+    uint32_t next = p_snapshot->sequence + 1;
+
+    p_snapshot->time[next & 1] = *p_time;
+    p_snapshot->timer[next & 1] = timer;
+    __DMB();
+    p_snapshot->sequence = next;
+}
+
+/**
+ * @brief  Copies the latest published time out of a snapshot.
+ * @note   Lock-free, the copy is retried if a publish overtook it.
+ * @param  p_snapshot The snapshot to read.
+ * @param  p_time Receives the time.
+ * @param  p_timer Receives the timer value stored with it, may be NULL.
+ */
+void MCP7940M_SnapshotRead(const MCP7940M_Snapshot *p_snapshot, MCP7940M_Time *p_time, uint32_t *p_timer)
+{
+    uint32_t sequence;
+    uint32_t timer;
+
+    do
+    {
+        sequence = p_snapshot->sequence;
+        __DMB();
+        *p_time = p_snapshot->time[sequence & 1];
+        timer = p_snapshot->timer[sequence & 1];
+        __DMB();
+    } while (sequence != p_snapshot->sequence);
+
+    if (p_timer != NULL)
+    {
+        *p_timer = timer;
+    }
+}
+
+/**
+ * @brief  Checks that every field of a time is in range.
+ * @note   Only the register masks bound what the chip returns, so a glitched
+ *         or corrupted chip can deliver e.g. month 0x13 or date 0.
+ * @param  p_time Time to check, the weekday is ignored.
+ * @retval 1 if seconds, minutes and hours are valid, month is 1..12, date
+ *         1..31 and year 0..99.
+ */
+uint8_t MCP7940M_TimeValid(const MCP7940M_Time *p_time)
+{
+    return p_time->seconds < 60 && p_time->minutes < 60 && p_time->hours < 24 && p_time->date >= 1 && p_time->date <= 31 &&
+           p_time->month >= 1 && p_time->month <= 12 && p_time->year <= 99;
+}
+
+/**
+ * @brief  Counts the days from 2000-01-01 to a date.
+ * @param  date Day of month, 1..31, clamped to that range.
+ * @param  month Month, 1..12, clamped to that range so that no value can
+ *               index outside the month tables.
+ * @param  year Year of the century, 0..99.
+ * @retval Number of days.
+ */
+uint32_t MCP7940M_DaysSince2000(uint8_t date, uint8_t month, uint8_t year)
+{
+    uint32_t days = year * 365UL + (year + 3U) / 4U; // Leap days of the years before.
+
+    month = (month < 1) ? 1 : ((month > 12) ? 12 : month);
+    date = (date < 1) ? 1 : ((date > 31) ? 31 : date);
+
+    days += MCP7940M_DaysBeforeMonth[month - 1] + date - 1;
+    if (month > 2 && (year & 0b11) == 0)
+    {
+        days++;
+    }
+    return days;
+}
+
+/**
+ * @brief  Converts a time to Unix time.
+ * @param  p_time Time within 2000..2099.
+ * @retval Seconds since 1970-01-01 00:00:00, MCP7940M_EPOCH_INVALID if a
+ *         field is out of range (see MCP7940M_TimeValid).
+ */
+uint32_t MCP7940M_TimeToEpoch(const MCP7940M_Time *p_time)
+{
+    if (!MCP7940M_TimeValid(p_time))
+    {
+        return MCP7940M_EPOCH_INVALID;
+    }
+    return MCP7940M_EPOCH_2000 + MCP7940M_DaysSince2000(p_time->date, p_time->month, p_time->year) * 86400UL +
+           p_time->hours * 3600UL + p_time->minutes * 60U + p_time->seconds;
+}
+
+/**
+ * @brief  Converts Unix time to a time.
+ * @note   2000-01-01 was a Saturday, the weekday follows the Weekday enum.
+ * @param  epoch Seconds since 1970-01-01 00:00:00, within 2000..2099.
+ * @param  p_time Receives the time.
+ */
+void MCP7940M_EpochToTime(uint32_t epoch, MCP7940M_Time *p_time)
+{
+    uint32_t seconds = epoch - MCP7940M_EPOCH_2000;
+    uint32_t days = seconds / 86400UL;
+    uint32_t remainder = seconds % 86400UL;
+    uint32_t dayOfYear;
+    uint32_t firstDay = 0;
+    uint8_t leap;
+    uint8_t month;
+
+    p_time->hours = remainder / 3600U;
+    remainder %= 3600U;
+    p_time->minutes = remainder / 60U;
+    p_time->seconds = remainder % 60U;
+    p_time->weekday = (Weekday)((days + SATURDAY) % 7);
+
+    /* Every four year cycle of the century starts with a leap year. */
+    p_time->year = (days / 1461U) * 4U;
+    dayOfYear = days % 1461U;
+    if (dayOfYear >= 366U)
+    {
+        dayOfYear -= 366U;
+        p_time->year += 1U + dayOfYear / 365U;
+        dayOfYear %= 365U;
+    }
+    leap = (p_time->year & 0b11) == 0;
+
+    for (month = 12; month > 1; month--)
+    {
+        firstDay = MCP7940M_DaysBeforeMonth[month - 1] + ((leap && month > 2) ? 1U : 0U);
+        if (dayOfYear >= firstDay)
+        {
+            break;
+        }
+    }
+    if (month == 1)
+    {
+        firstDay = 0;
+    }
+    p_time->month = month;
+    p_time->date = dayOfYear - firstDay + 1;
+}
+
+/**
+ * @brief  Packs a time into 32 bits.
+ * @param  p_time Time within 2000..2063, the weekday is ignored.
+ * @retval Packed time, MCP7940M_PACKED_INVALID if a field is out of range.
+ */
+MCP7940M_PackedTime MCP7940M_PackTime(const MCP7940M_Time *p_time)
+{
+    if (p_time->year > MCP7940M_PACKED_MAX_YEAR || !MCP7940M_TimeValid(p_time))
+    {
+        return MCP7940M_PACKED_INVALID;
+    }
+    return ((uint32_t)p_time->year << MCP7940M_PACKED_YEAR_SHIFT) | ((uint32_t)p_time->month << MCP7940M_PACKED_MONTH_SHIFT) |
+           ((uint32_t)p_time->date << MCP7940M_PACKED_DATE_SHIFT) | ((uint32_t)p_time->hours << MCP7940M_PACKED_HOURS_SHIFT) |
+           ((uint32_t)p_time->minutes << MCP7940M_PACKED_MINUTES_SHIFT) | ((uint32_t)p_time->seconds << MCP7940M_PACKED_SECONDS_SHIFT);
+}
+
+/**
+ * @brief  Packs a raw RTCSEC..RTCYEAR block without going through MCP7940M_Time.
+ * @param  p_regs MCP7940M_TIME_REG_COUNT registers as read from the chip.
+ * @retval Packed time, MCP7940M_PACKED_INVALID if a field is out of range.
+ */
+MCP7940M_PackedTime MCP7940M_PackRegisters(const uint8_t *p_regs)
+{
+    MCP7940M_Time time;
+
+    MCP7940M_DecodeTimeBlock(p_regs, &time);
+    return MCP7940M_PackTime(&time);
+}
+
+/**
+ * @brief  Unpacks a packed time.
+ * @param  packed Valid packed time.
+ * @param  p_time Receives the fields, the weekday computed from the date.
+ */
+void MCP7940M_UnpackTime(MCP7940M_PackedTime packed, MCP7940M_Time *p_time)
+{
+    p_time->year = (uint8_t)((packed >> MCP7940M_PACKED_YEAR_SHIFT) & 0b111111);
+    p_time->month = (uint8_t)((packed >> MCP7940M_PACKED_MONTH_SHIFT) & 0b1111);
+    p_time->date = (uint8_t)((packed >> MCP7940M_PACKED_DATE_SHIFT) & 0b11111);
+    p_time->hours = (uint8_t)((packed >> MCP7940M_PACKED_HOURS_SHIFT) & 0b11111);
+    p_time->minutes = (uint8_t)((packed >> MCP7940M_PACKED_MINUTES_SHIFT) & 0b111111);
+    p_time->seconds = (uint8_t)((packed >> MCP7940M_PACKED_SECONDS_SHIFT) & 0b111111);
+    p_time->weekday = (Weekday)((MCP7940M_DaysSince2000(p_time->date, p_time->month, p_time->year) + SATURDAY) % 7);
+}
+
+/**
+ * @brief  Unpacks a packed time into a raw RTCSEC..RTCYEAR block.
+ * @note   Encoded like MCP7940M_SetTime: ST set, 24 hour format.
+ * @param  packed Valid packed time.
+ * @param  p_regs Receives MCP7940M_TIME_REG_COUNT registers.
+ */
+void MCP7940M_UnpackRegisters(MCP7940M_PackedTime packed, uint8_t *p_regs)
+{
+    MCP7940M_Time time;
+
+    MCP7940M_UnpackTime(packed, &time);
+    p_regs[0] = MCP7940M_BCDEncode(time.seconds) | MCP7940M_RTCSEC_ST;
+    p_regs[1] = MCP7940M_BCDEncode(time.minutes);
+    p_regs[2] = MCP7940M_BCDEncode(time.hours);
+    p_regs[3] = MCP7940M_EncodeWeekday(time.weekday);
+    p_regs[4] = MCP7940M_BCDEncode(time.date);
+    p_regs[5] = MCP7940M_BCDEncode(time.month);
+    p_regs[6] = MCP7940M_BCDEncode(time.year);
+}
+
+/**
+ * @brief  Seconds from b to a.
+ * @param  a Valid packed time.
+ * @param  b Valid packed time.
+ * @retval a - b in seconds, negative if a is earlier.
+ */
+int32_t MCP7940M_PackedDiff(MCP7940M_PackedTime a, MCP7940M_PackedTime b)
+{
+    int32_t days;
+    int32_t seconds;
+
+    if ((a >> MCP7940M_PACKED_DATE_SHIFT) == (b >> MCP7940M_PACKED_DATE_SHIFT))
+    {
+        days = 0; // Same day, the common case of nearby timestamps.
+    }
+    else
+    {
+        days = (int32_t)MCP7940M_DaysSince2000((a >> MCP7940M_PACKED_DATE_SHIFT) & 0b11111, (a >> MCP7940M_PACKED_MONTH_SHIFT) & 0b1111,
+                                               (uint8_t)(a >> MCP7940M_PACKED_YEAR_SHIFT)) -
+               (int32_t)MCP7940M_DaysSince2000((b >> MCP7940M_PACKED_DATE_SHIFT) & 0b11111, (b >> MCP7940M_PACKED_MONTH_SHIFT) & 0b1111,
+                                               (uint8_t)(b >> MCP7940M_PACKED_YEAR_SHIFT));
+    }
+
+    seconds = (int32_t)(((a >> MCP7940M_PACKED_HOURS_SHIFT) & 0b11111) * 3600UL + ((a >> MCP7940M_PACKED_MINUTES_SHIFT) & 0b111111) * 60UL +
+                        (a & 0b111111)) -
+              (int32_t)(((b >> MCP7940M_PACKED_HOURS_SHIFT) & 0b11111) * 3600UL + ((b >> MCP7940M_PACKED_MINUTES_SHIFT) & 0b111111) * 60UL +
+                        (b & 0b111111));
+    return days * 86400L + seconds;
 }
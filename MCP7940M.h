@@ -3,7 +3,9 @@
  *
  * This file contains the declarations for the driver of the MCP7940M Real-Time Clock (RTC) using the STM32F429 microcontroller.
  * The driver provides functions to initialize the RTC, set and get the time, and read/write individual time registers.
- * The driver uses the HAL library for I2C communication.
+ * The driver uses the HAL library for I2C communication by default, other buses
+ * can be plugged in through MCP7940M_Transport (define MCP7940M_NO_HAL to build
+ * without the HAL).
  *
  * Created on: Nov 6, 2024
  *
@@ -33,13 +35,92 @@
 #ifndef INC_MCP7940M_H_
 #define INC_MCP7940M_H_
 
-#include "stm32f4xx_hal.h" /* Needed for I2C */
-#include <stdint.h>        /* Needed for uint8_t etc. */
+#ifndef MCP7940M_NO_HAL
+#ifndef MCP7940M_HAL_HEADER
+#define MCP7940M_HAL_HEADER "stm32f4xx_hal.h"
+#endif
+#include MCP7940M_HAL_HEADER /* Needed for I2C */
+#endif
+#include <stddef.h> /* Needed for NULL */
+#include <stdint.h> /* Needed for uint8_t etc. */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef MCP7940M_NO_HAL
+/* Without the HAL the driver keeps the HAL status codes and CMSIS helpers it uses. */
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+#ifndef __ALIGNED
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#endif
+#ifndef __DMB
+#define __DMB() __sync_synchronize()
+#endif
+#endif /* MCP7940M_NO_HAL */
+
+/* Short critical sections for state shared with interrupts, override for other platforms. */
+#ifndef MCP7940M_CRITICAL_ENTER
+#ifdef MCP7940M_NO_HAL
+#define MCP7940M_CRITICAL_ENTER() uint32_t criticalState = 0
+#define MCP7940M_CRITICAL_EXIT() (void)criticalState
+#else
+#define MCP7940M_CRITICAL_ENTER() \
+    uint32_t criticalState = __get_PRIMASK(); \
+    __disable_irq()
+#define MCP7940M_CRITICAL_EXIT() __set_PRIMASK(criticalState)
+#endif
+#endif
+
+/*
+ * Define MCP7940M_ENABLE_STATS to collect per-operation cycle counts and bus
+ * counters in MCP7940M.stats. Without it the instrumentation compiles to nothing.
+ */
+#ifdef MCP7940M_ENABLE_STATS
+#ifndef MCP7940M_CYCLES
+#ifdef MCP7940M_NO_HAL
+#define MCP7940M_CYCLES() 0U
+#else
+#define MCP7940M_CYCLES() (DWT->CYCCNT)
+#endif
+#endif
+#define MCP7940M_STATS_BEGIN(start) uint32_t start = MCP7940M_CYCLES()
+#define MCP7940M_STATS_END(p, op, start) MCP7940M_StatsRecord(&(p)->stats.ops[op], MCP7940M_CYCLES() - (start))
+#define MCP7940M_STATS_ADD(p, counter, n) ((p)->stats.counter += (n))
+#else
+#define MCP7940M_STATS_BEGIN(start)
+#define MCP7940M_STATS_END(p, op, start) ((void)0)
+#define MCP7940M_STATS_ADD(p, counter, n) ((void)0)
+#endif
 
 /*
  * DEFINES
  */
 #define MCP7940M_I2C_ADDRESS (0x6F << 1) /* Datasheet p.8 */
+#define MCP7940M_DEFAULT_BUS_HZ 100000   /* Assumed SCL frequency until MCP7940M_SetBusSpeed */
+#define MCP7940M_MAX_BUS_HZ 400000       /* Fastest SCL the MCP7940M supports, no Fast Mode Plus */
+#define MCP7940M_TIMEOUT_MARGIN 2        /* ms added to the wire time of a transfer for its timeout */
+#define MCP7940M_DEFAULT_RETRIES 2       /* Retries of a failed blocking transfer */
+#define MCP7940M_DEFAULT_BACKOFF 1       /* ms before the first retry, doubled for each further one */
+#define MCP7940M_RECOVERY_DELAY 50       /* Busy loop iterations per half SCL period of the bus recovery */
+#define MCP7940M_GROUP_MAX 8             /* Devices per MCP7940M_Group */
+#define MCP7940M_TICK_SYNC_ATTEMPTS 3    /* Time reads of the second counter sync, retried if an edge interrupts one */
+#define MCP7940M_TXN_MAX_BURSTS 8        /* Bursts per MCP7940M_TxnList */
+#define MCP7940M_TXN_MAX_READS 8         /* Queued reads per MCP7940M_TxnList */
+#define MCP7940M_TXN_BUFFER_SIZE 32      /* Data bytes per MCP7940M_TxnList */
+#define MCP7940M_EVENT_QUEUE_SIZE 64     /* Events per MCP7940M_EventQueue, a power of two */
+#define MCP7940M_TXN_READ_GAP 3          /* Unused registers a read burst may span, cheaper than a new transfer */
+#define MCP7940M_OSCRUN_TIMEOUT 10       /* ms to wait for OSCRUN to clear after ST is cleared */
+#define MCP7940M_EPOCH_2000 946684800UL  /* Unix time of 2000-01-01 00:00:00, year 00 of the chip */
+#define MCP7940M_EPOCH_INVALID 0UL       /* Conversion result for a time with a field out of range */
+#define MCP7940M_EPOCH_2100 4102444800UL /* First Unix time the chip cannot hold */
 
 /*
  * REGISTERS
@@ -68,6 +149,45 @@
 #define MCP7940M_REG_ALM1DATE 0x15
 #define MCP7940M_REG_ALM1MTH 0x16
 
+#define MCP7940M_TIME_REG_COUNT 7 /* RTCSEC..RTCYEAR, read/written as one burst */
+#define MCP7940M_RAW_BUFFER_SIZE 8 /* MCP7940M_TIME_REG_COUNT rounded up to whole words */
+#define MCP7940M_REG_MAP_SIZE 0x17 /* RTCSEC..ALM1MTH, mirrored by the shadow cache */
+
+#define MCP7940M_REG_SRAM 0x20  /* First of the general purpose SRAM bytes */
+#define MCP7940M_SRAM_SIZE 64   /* 0x20..0x5F, kept across MCU resets while the chip is powered */
+
+/*
+ * REGISTER BITS
+ */
+#define MCP7940M_RTCSEC_ST (1 << 7)      /* Start oscillator */
+#define MCP7940M_RTCHOUR_12_24 (1 << 6)  /* 12 hour format when set */
+#define MCP7940M_RTCHOUR_PM (1 << 5)     /* PM, 12 hour format only */
+#define MCP7940M_RTCWKDAY_OSCRUN (1 << 5) /* Oscillator running (read only) */
+#define MCP7940M_RTCMTH_LP (1 << 5)      /* Leap year (read only) */
+
+#define MCP7940M_CONTROL_OUT (1 << 7)     /* MFP level when SQWEN and ALMxEN are clear */
+#define MCP7940M_CONTROL_SQWEN (1 << 6)   /* Square wave output on MFP */
+#define MCP7940M_CONTROL_ALM1EN (1 << 5)  /* Alarm 1 enable */
+#define MCP7940M_CONTROL_ALM0EN (1 << 4)  /* Alarm 0 enable */
+#define MCP7940M_CONTROL_EXTOSC (1 << 3)  /* External 32.768 kHz clock input */
+#define MCP7940M_CONTROL_CRSTRIM (1 << 2) /* Coarse trim mode */
+#define MCP7940M_CONTROL_SQWFS 0b00000011 /* Square wave frequency select */
+#define MCP7940M_SQWFS_1HZ 0b00
+#define MCP7940M_SQWFS_4096HZ 0b01
+#define MCP7940M_SQWFS_8192HZ 0b10
+#define MCP7940M_SQWFS_32768HZ 0b11
+
+#define MCP7940M_OSCTRIM_SIGN (1 << 7)  /* Add clock cycles when set, subtract when clear */
+#define MCP7940M_OSCTRIM_TRIMVAL 0x7F  /* Two clock cycles per minute per step */
+#define MCP7940M_TRIM_STEP_SCALE 983040ULL    /* Trim steps = error [ppb] * scale / 10^9, i.e. 32768 Hz * 60 s / 2 cycles */
+#define MCP7940M_TRIM_COARSE_RATIO 7680      /* Fine steps per coarse step, CRSTRIM applies the trim 128 times a second instead of once a minute */
+#define MCP7940M_TRIM_PERIOD 60              /* Seconds between two normal trim corrections */
+
+#define MCP7940M_ALMWKDAY_ALMPOL (1 << 7)    /* MFP alarm polarity, ALM0WKDAY only, applies to both alarms */
+#define MCP7940M_ALMWKDAY_ALMMSK 0b01110000 /* Alarm match mask */
+#define MCP7940M_ALMWKDAY_ALMIF (1 << 3)     /* Alarm interrupt flag */
+#define MCP7940M_ALARM_REG_COUNT 6           /* ALMxSEC..ALMxMTH, written as one burst */
+
 /*
  * WEEKDAY ENUM
  */
@@ -83,12 +203,389 @@ typedef enum
 } Weekday;
 
 /*
- * MCP7940M STRUCT
+ * TIME STRUCT
+ */
+typedef struct
+{
+    uint8_t seconds;
+    uint8_t minutes;
+    uint8_t hours;
+    Weekday weekday;
+    uint8_t date;
+    uint8_t month;
+    uint8_t year;
+} MCP7940M_Time;
+
+/*
+ * PACKED TIME
+ * A time in 32 bits with the fields ordered from the year down, so packed
+ * times compare and sort as plain integers. The full 2000..2099 range would
+ * need 33 bits, so the year field covers 2000..2063. The weekday is not
+ * stored, it follows from the date.
+ */
+typedef uint32_t MCP7940M_PackedTime;
+
+#define MCP7940M_PACKED_INVALID 0xFFFFFFFFUL /* Returned for times that cannot be packed */
+#define MCP7940M_PACKED_MAX_YEAR 63
+
+#define MCP7940M_PACKED_YEAR_SHIFT 26    /* 6 bits, 0..63 */
+#define MCP7940M_PACKED_MONTH_SHIFT 22   /* 4 bits, 1..12 */
+#define MCP7940M_PACKED_DATE_SHIFT 17    /* 5 bits, 1..31 */
+#define MCP7940M_PACKED_HOURS_SHIFT 12   /* 5 bits, 0..23 */
+#define MCP7940M_PACKED_MINUTES_SHIFT 6  /* 6 bits, 0..59 */
+#define MCP7940M_PACKED_SECONDS_SHIFT 0  /* 6 bits, 0..59 */
+
+/*
+ * ALARMS
  */
+typedef enum
+{
+    MCP7940M_ALARM_0 = 0,
+    MCP7940M_ALARM_1
+} MCP7940M_AlarmIndex;
+
+typedef enum
+{
+    MCP7940M_ALARM_MATCH_SECONDS = 0b000,
+    MCP7940M_ALARM_MATCH_MINUTES = 0b001,
+    MCP7940M_ALARM_MATCH_HOURS = 0b010,
+    MCP7940M_ALARM_MATCH_WEEKDAY = 0b011,
+    MCP7940M_ALARM_MATCH_DATE = 0b100,
+    MCP7940M_ALARM_MATCH_ALL = 0b111 /* Seconds, minutes, hours, weekday, date and month */
+} MCP7940M_AlarmMatch;
+
+typedef struct
+{
+    uint8_t seconds;
+    uint8_t minutes;
+    uint8_t hours;
+    Weekday weekday;
+    uint8_t date;
+    uint8_t month;
+    MCP7940M_AlarmMatch match;
+} MCP7940M_Alarm;
+
+/*
+ * CALIBRATION
+ * Measurement of the 1 Hz MFP output against a reference timer. Edges are
+ * fed from interrupts; the result is only read once the window is complete.
+ */
+typedef struct
+{
+    uint32_t refHz;   /* Nominal reference timer frequency */
+    uint32_t seconds; /* Measurement window in MFP seconds */
+
+    /* MFP edges captured with the reference timer */
+    volatile uint32_t rtcCount;
+    uint32_t rtcLast;
+    uint64_t rtcTicks;
+
+    /* Optional PPS edges captured with the same timer, measure its real frequency */
+    volatile uint32_t ppsCount;
+    uint32_t ppsLast;
+    uint64_t ppsTicks;
+} MCP7940M_Calibration;
+
+/*
+ * DRIFT MONITOR
+ * Least squares fit of the RTC offset against a reference clock, updated one
+ * sample at a time. Offsets removed by resyncs are added back, so the fit
+ * stays continuous across them.
+ */
+typedef struct
+{
+    /* Configuration */
+    uint32_t boundMs;     /* Largest RTC error tolerated before a resync */
+    uint32_t minInterval; /* Shortest resync interval in seconds */
+    uint32_t maxInterval; /* Longest resync interval in seconds */
+
+    /* Fit, x in reference seconds since origin, y in ms of RTC ahead of the reference */
+    uint32_t origin;
+    uint32_t count;
+    double meanX;
+    double meanY;
+    double sxx;
+    double sxy;
+    int32_t correction; /* ms removed by resyncs since origin */
+    int32_t lastOffset; /* Offset of the last sample as measured */
+} MCP7940M_Drift;
+
+/*
+ * SRAM RING
+ * Fixed size records in a region of SRAM. Each slot starts with a sequence
+ * tag, 1..255 and wrapping past 0, so the newest record is found from the
+ * tags alone and an append is a single write of one slot.
+ */
+typedef struct
+{
+    uint8_t base;      /* SRAM offset of the first slot */
+    uint8_t slotSize;  /* Bytes per slot including the tag */
+    uint8_t slotCount;
+    uint8_t next;      /* Slot the next record goes to */
+    uint8_t sequence;  /* Tag of the next record */
+    uint8_t count;     /* Records held, at most slotCount */
+} MCP7940M_SramRing;
+
+/*
+ * REGISTER DUMP
+ * Raw snapshot for telemetry: a 4 byte header (magic, version, flags,
+ * register count), RTCSEC..ALM1MTH and, with MCP7940M_DUMP_FLAG_SRAM, the
+ * 64 SRAM bytes. Decoding only needs the raw bytes, so the same functions
+ * serve firmware and host tools.
+ */
+#define MCP7940M_DUMP_MAGIC 0xD7
+#define MCP7940M_DUMP_VERSION 1
+#define MCP7940M_DUMP_HEADER_SIZE 4
+#define MCP7940M_DUMP_FLAG_SRAM (1 << 0) /* SRAM follows the registers */
+#define MCP7940M_DUMP_MAX_SIZE (MCP7940M_DUMP_HEADER_SIZE + MCP7940M_REG_MAP_SIZE + MCP7940M_SRAM_SIZE)
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t flags;
+    const uint8_t *p_regs; /* RTCSEC..ALM1MTH */
+    const uint8_t *p_sram; /* MCP7940M_SRAM_SIZE bytes, NULL if not included */
+} MCP7940M_DumpView;
+
+/*
+ * TIME SNAPSHOT
+ * Double buffered copy of a time, written by one context and read lock-free
+ * by any number of others. sequence is incremented on every publish and its
+ * lowest bit selects the buffer readers copy from.
+ */
+typedef struct
+{
+    MCP7940M_Time time[2];
+    uint32_t timer[2]; /* Free-running timer value belonging to time */
+    volatile uint32_t sequence;
+} MCP7940M_Snapshot;
+
+/* Free-running timer used to interpolate between the 1 Hz MFP edges. */
+typedef uint32_t (*MCP7940M_TimerRead)(void);
+
+/*
+ * EVENT CAPTURE
+ * Single producer, single consumer queue of events stamped with a cheap
+ * timer tick in interrupt context. The consumer converts the ticks to RTC
+ * time against an anchor that is taken at most once per second.
+ */
+typedef struct
+{
+    uint32_t id;
+    uint32_t tick; /* Timer value at the event */
+} MCP7940M_Event;
+
+typedef struct
+{
+    uint32_t id;
+    uint32_t epoch;    /* Unix time of the event */
+    uint32_t fraction; /* Timer ticks into that second */
+} MCP7940M_EventStamp;
+
+typedef void (*MCP7940M_EventHandler)(void *p_context, const MCP7940M_EventStamp *p_stamp);
+
+typedef struct
+{
+    MCP7940M_Event events[MCP7940M_EVENT_QUEUE_SIZE];
+    volatile uint32_t head; /* Written by the producer only */
+    volatile uint32_t tail; /* Written by the consumer only */
+    volatile uint32_t dropped;
+
+    /* Consumer side */
+    MCP7940M_TimerRead timerRead; /* Same timer the producer stamps with */
+    uint32_t tickHz;
+    uint32_t anchorEpoch;
+    uint32_t anchorTick; /* Timer value at anchorEpoch */
+    uint8_t anchorValid;
+} MCP7940M_EventQueue;
+
+/*
+ * ASYNCHRONOUS TRANSFER STATE
+ */
+typedef enum
+{
+    MCP7940M_STATE_READY = 0, /* No transfer in progress */
+    MCP7940M_STATE_BUSY,      /* An _IT operation is running */
+    MCP7940M_STATE_ERROR      /* The last _IT operation failed, a new one may be started */
+} MCP7940M_State;
+
+struct MCP7940M;
+
+/* Completion callback of the _IT operations, called from interrupt context. */
+typedef void (*MCP7940M_Callback)(struct MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+
+/*
+ * CHANGE NOTIFICATION
+ * One field per timekeeping register, the field index is its offset from
+ * RTCSEC and (1 << field) its bit in a changed mask.
+ */
+typedef enum
+{
+    MCP7940M_FIELD_SECONDS = 0,
+    MCP7940M_FIELD_MINUTES,
+    MCP7940M_FIELD_HOURS,
+    MCP7940M_FIELD_WEEKDAY,
+    MCP7940M_FIELD_DATE,
+    MCP7940M_FIELD_MONTH,
+    MCP7940M_FIELD_YEAR
+} MCP7940M_Field;
+
+#define MCP7940M_CHANGED_ALL 0b01111111 /* Every field, e.g. on the first read */
+
+/* Called by MCP7940M_GetTimeChanges for a field that changed, with the mask of all changed fields. */
+typedef void (*MCP7940M_ChangeCallback)(struct MCP7940M *p_mcp7940m, uint8_t changed);
+
+#ifdef MCP7940M_ENABLE_STATS
+/*
+ * INSTRUMENTATION
+ */
+typedef enum
+{
+    MCP7940M_STATS_GET_TIME = 0,
+    MCP7940M_STATS_SET_TIME,
+    MCP7940M_STATS_READ,  /* MCP7940M_ReadRegisters */
+    MCP7940M_STATS_WRITE, /* MCP7940M_WriteRegisters */
+    MCP7940M_STATS_OP_COUNT
+} MCP7940M_StatsOp;
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t minCycles;
+    uint32_t maxCycles;
+    uint64_t totalCycles; /* Average is totalCycles / count */
+} MCP7940M_CycleStats;
+
+typedef struct
+{
+    MCP7940M_CycleStats ops[MCP7940M_STATS_OP_COUNT];
+    uint32_t transactions; /* Blocking and asynchronous transfers started */
+    uint32_t bytesRead;    /* Data bytes of the transfers started */
+    uint32_t bytesWritten;
+    uint32_t errors;       /* Transfers ending in HAL_ERROR or HAL_BUSY */
+    uint32_t timeouts;     /* Transfers ending in HAL_TIMEOUT */
+    uint32_t retries;
+    uint32_t recoveries;   /* Bus recovery attempts */
+} MCP7940M_Stats;
+#endif
+
+/*
+ * BUS TRANSPORT
+ * Platform specific I2C access. address is the 8 bit (HAL style) device
+ * address. An asynchronous transfer must stay valid until the transport
+ * reports its completion with MCP7940M_TransferComplete.
+ */
+typedef struct
+{
+    /* Blocking burst transfers, required */
+    HAL_StatusTypeDef (*read)(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint32_t timeout);
+    HAL_StatusTypeDef (*write)(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint32_t timeout);
+
+    /* Non-blocking burst transfers, NULL if unsupported. dma selects DMA over interrupts where available */
+    HAL_StatusTypeDef (*readAsync)(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint8_t dma);
+    HAL_StatusTypeDef (*writeAsync)(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint8_t dma);
+
+    /* Millisecond tick, required */
+    uint32_t (*getTick)(void *p_context);
+} MCP7940M_Transport;
+
+/* Mutual exclusion around bus transactions, e.g. an RTOS mutex shared by all devices on a bus. */
+typedef void (*MCP7940M_BusLock)(void *p_context);
+
+/* Frees a stuck bus, e.g. MCP7940M_HAL_BusRecover. */
+typedef HAL_StatusTypeDef (*MCP7940M_BusRecover)(void *p_context);
+
+#ifndef MCP7940M_NO_HAL
+/* Bus recovery context of MCP7940M_HAL_BusRecover. */
 typedef struct
 {
-    /* I2C handle */
     I2C_HandleTypeDef *i2cHandle;
+    GPIO_TypeDef *sclPort;
+    uint16_t sclPin;
+    GPIO_TypeDef *sdaPort;
+    uint16_t sdaPin;
+} MCP7940M_HAL_BusPins;
+#endif
+
+/*
+ * TRANSACTION LISTS
+ * Reads and writes queued in order. Each one is merged into the previous
+ * burst when it continues it, so a list runs as few transfers as possible.
+ */
+typedef struct
+{
+    uint8_t write;
+    uint8_t reg;
+    uint8_t length;
+    uint8_t offset; /* Position of the data in the list buffer */
+} MCP7940M_TxnBurst;
+
+typedef struct
+{
+    uint8_t *p_data; /* Caller buffer filled after execution */
+    uint8_t offset;
+    uint8_t length;
+} MCP7940M_TxnRead;
+
+typedef struct MCP7940M_TxnList
+{
+    MCP7940M_TxnBurst bursts[MCP7940M_TXN_MAX_BURSTS];
+    uint8_t burstCount;
+    MCP7940M_TxnRead reads[MCP7940M_TXN_MAX_READS];
+    uint8_t readCount;
+    uint8_t used;
+    /* Write data copied at queue time and read data, word aligned for DMA */
+    __ALIGNED(4) uint8_t buffer[MCP7940M_TXN_BUFFER_SIZE];
+} MCP7940M_TxnList;
+
+/*
+ * COOPERATIVE TASKS
+ * A sequence driven by MCP7940M_Poll, which runs at most one register
+ * transfer per call.
+ */
+typedef enum
+{
+    MCP7940M_TASK_NONE = 0,
+    MCP7940M_TASK_INIT,
+    MCP7940M_TASK_GET_TIME,
+    MCP7940M_TASK_SET_TIME,
+    MCP7940M_TASK_SET_ALARM,
+    MCP7940M_TASK_CALIBRATE
+} MCP7940M_TaskOp;
+
+typedef struct
+{
+    MCP7940M_TaskOp op; /* Running sequence, MCP7940M_TASK_NONE when finished */
+    uint8_t step;
+    uint32_t start;            /* Tick at which the current wait began */
+    HAL_StatusTypeDef status;  /* Result of the last finished sequence */
+    uint8_t regs[MCP7940M_TIME_REG_COUNT];
+    MCP7940M_AlarmIndex alarm;
+    MCP7940M_Alarm alarmTime;
+    MCP7940M_Calibration *p_cal;
+    int32_t errorPpb;
+} MCP7940M_Task;
+
+/*
+ * MCP7940M STRUCT
+ */
+typedef struct MCP7940M
+{
+    /* Bus */
+    const MCP7940M_Transport *transport;
+    void *busContext; /* Passed to the transport, the I2C handle for the HAL transport */
+    uint32_t busHz;           /* SCL frequency the timeouts are computed for */
+    uint32_t timeoutMargin;   /* ms added to the wire time of each transfer */
+    uint8_t retries;          /* Retries of a failed blocking transfer */
+    uint8_t retryBackoff;     /* ms before the first retry */
+    MCP7940M_BusRecover busRecover; /* Called after a timed out transfer, may be NULL */
+    void *recoverContext;
+    MCP7940M_BusLock busLock;   /* Taken around every blocking transfer, may be NULL */
+    MCP7940M_BusLock busUnlock;
+    void *lockContext;
+    MCP7940M_BusLock busPowerUp;   /* Called before every transfer, may be NULL */
+    MCP7940M_BusLock busPowerDown; /* Called after every transfer, may be NULL */
+    void *powerContext;
 
     /* Time */
     uint8_t seconds;
@@ -98,12 +595,93 @@ typedef struct
     uint8_t date;
     uint8_t month;
     uint8_t year;
+    uint8_t twelveHour; /* The chip keeps RTCHOUR and ALMxHOUR in 12 hour format */
+
+    /* Change notification */
+    uint8_t changeRaw[MCP7940M_TIME_REG_COUNT]; /* Burst of the last MCP7940M_GetTimeChanges */
+    uint8_t changeValid;                        /* changeRaw holds a burst */
+    MCP7940M_ChangeCallback onChange[MCP7940M_TIME_REG_COUNT];
+
+    /* Asynchronous transfers */
+    volatile MCP7940M_State state;
+    MCP7940M_Callback callback;
+    void *callbackContext; /* Free for use by the callback owner */
+    uint8_t asyncOp;
+    uint8_t asyncStep;
+    uint32_t asyncStart;
+    uint8_t asyncDma;     /* Ask the transport for DMA instead of interrupt transfers */
+    uint8_t asyncScratch; /* Single register transfers of multi-step operations */
+    MCP7940M_TxnList *txnList; /* List run by MCP7940M_TxnExecute_IT/_DMA */
+
+    /* Raw RTCSEC..RTCYEAR of the last transfer, word aligned for DMA and padded to whole words */
+    __ALIGNED(4) uint8_t raw[MCP7940M_RAW_BUFFER_SIZE];
+
+    /* Shadow of the register map, one bit per register in the masks */
+    uint8_t shadow[MCP7940M_REG_MAP_SIZE];
+    uint32_t shadowValid; /* Register value is known */
+    uint32_t shadowDirty; /* Register value is staged but not yet written */
+
+    /* 1 Hz MFP second counter */
+    MCP7940M_TimerRead timerRead;
+    uint32_t timerHz;
+    MCP7940M_Snapshot tick; /* Counted time and the timer value at its edge */
+    volatile uint32_t tickEdges; /* Edges seen by MCP7940M_SecondTickCallback */
+    volatile uint8_t tickState;
+    uint32_t syncEdges;          /* tickEdges when syncTime was read */
+    MCP7940M_Time syncTime;      /* Time read between two edges, taken over by the next edge */
+
+    /* Time published by MCP7940M_Refresh, timer holds the tick of the read */
+    MCP7940M_Snapshot snapshot;
+
+    /* Epoch of 00:00:00 on epochDate/epochMonth/epochYear, epochMonth 0 if unset */
+    uint32_t epochDayStart;
+    uint8_t epochDate;
+    uint8_t epochMonth;
+    uint8_t epochYear;
+
+#ifdef MCP7940M_ENABLE_STATS
+    MCP7940M_Stats stats;
+#endif
 } MCP7940M;
 
+/*
+ * MULTI-DEVICE GROUP
+ * Samples several MCP7940M at once, each on its own bus, all read
+ * concurrently. The MCP7940M has the fixed address 0x6F, so several on one
+ * bus need an I2C mux, which this driver does not handle.
+ */
+struct MCP7940M_Group;
+
+/* Called from interrupt context once every device of the group has been read. */
+typedef void (*MCP7940M_GroupCallback)(struct MCP7940M_Group *p_group);
+
+typedef struct MCP7940M_Group
+{
+    MCP7940M *devices[MCP7940M_GROUP_MAX];
+    uint8_t count;
+    void *savedContext[MCP7940M_GROUP_MAX]; /* Device callbackContext while a sample runs */
+    uint32_t tolerance;                     /* Seconds a device may deviate from the median */
+    uint8_t dma;
+    MCP7940M_GroupCallback callback;
+    volatile uint8_t pending;
+
+    /* Results of the last sample */
+    uint32_t epoch[MCP7940M_GROUP_MAX];
+    uint32_t errorMask;  /* Devices whose read failed or returned a time out of range */
+    uint32_t faultMask;  /* Devices outside tolerance of the median or with a time out of range */
+    uint32_t median;     /* Median epoch of the devices read */
+    uint32_t spread;     /* Largest minus smallest epoch of the devices read */
+} MCP7940M_Group;
+
 /*
  * INITIALISATION
  */
-void MCP7940M_Init(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
+HAL_StatusTypeDef MCP7940M_InitTransport(MCP7940M *p_mcp7940m, const MCP7940M_Transport *p_transport, void *p_busContext);
+#ifndef MCP7940M_NO_HAL
+HAL_StatusTypeDef MCP7940M_Init(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
+
+extern const MCP7940M_Transport MCP7940M_HAL_Transport;
+#endif
 
 /*
  * GET AND SET TIME
@@ -111,38 +689,309 @@ void MCP7940M_Init(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
 HAL_StatusTypeDef MCP7940M_GetTime(MCP7940M *p_mcp7940m);
 HAL_StatusTypeDef MCP7940M_SetTime(MCP7940M *p_mcp7940m);
 
+/*
+ * CHANGE NOTIFICATION
+ */
+HAL_StatusTypeDef MCP7940M_GetTimeChanges(MCP7940M *p_mcp7940m, uint8_t *p_changed);
+void MCP7940M_SetChangeCallback(MCP7940M *p_mcp7940m, MCP7940M_Field field, MCP7940M_ChangeCallback callback);
+
+/*
+ * SHARED ACCESS
+ */
+void MCP7940M_SetBusLock(MCP7940M *p_mcp7940m, MCP7940M_BusLock lock, MCP7940M_BusLock unlock, void *p_context);
+HAL_StatusTypeDef MCP7940M_Refresh(MCP7940M *p_mcp7940m);
+void MCP7940M_ReadSnapshot(const MCP7940M *p_mcp7940m, MCP7940M_Time *p_time, uint32_t *p_tick);
+
+/*
+ * EPOCH TIME
+ */
+HAL_StatusTypeDef MCP7940M_GetEpoch(MCP7940M *p_mcp7940m, uint32_t *p_epoch);
+HAL_StatusTypeDef MCP7940M_SetEpoch(MCP7940M *p_mcp7940m, uint32_t epoch);
+uint32_t MCP7940M_FieldsToEpoch(MCP7940M *p_mcp7940m);
+
+/*
+ * NON-BLOCKING GET AND SET TIME
+ */
+HAL_StatusTypeDef MCP7940M_GetTime_IT(MCP7940M *p_mcp7940m, MCP7940M_Callback callback);
+HAL_StatusTypeDef MCP7940M_SetTime_IT(MCP7940M *p_mcp7940m, MCP7940M_Callback callback);
+HAL_StatusTypeDef MCP7940M_GetTime_DMA(MCP7940M *p_mcp7940m, MCP7940M_Callback callback);
+HAL_StatusTypeDef MCP7940M_SetTime_DMA(MCP7940M *p_mcp7940m, MCP7940M_Callback callback);
+void MCP7940M_DecodeTime(MCP7940M *p_mcp7940m);
+void MCP7940M_TransferComplete(MCP7940M *p_mcp7940m, HAL_StatusTypeDef status);
+#ifndef MCP7940M_NO_HAL
+void MCP7940M_I2C_MemRxCpltCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
+void MCP7940M_I2C_MemTxCpltCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
+void MCP7940M_I2C_ErrorCallback(MCP7940M *p_mcp7940m, I2C_HandleTypeDef *p_i2cHandle);
+#endif
+
+/*
+ * MULTI-DEVICE GROUP
+ */
+HAL_StatusTypeDef MCP7940M_GroupInit(MCP7940M_Group *p_group, MCP7940M **pp_devices, uint8_t count, uint32_t tolerance);
+HAL_StatusTypeDef MCP7940M_GroupStart(MCP7940M_Group *p_group, uint8_t dma, MCP7940M_GroupCallback callback);
+uint8_t MCP7940M_GroupBusy(const MCP7940M_Group *p_group);
+
+/*
+ * TRANSACTION LISTS
+ */
+void MCP7940M_TxnInit(MCP7940M_TxnList *p_list);
+HAL_StatusTypeDef MCP7940M_TxnQueueRead(MCP7940M_TxnList *p_list, uint8_t reg, uint8_t *p_data, uint8_t length);
+HAL_StatusTypeDef MCP7940M_TxnQueueWrite(MCP7940M_TxnList *p_list, uint8_t reg, const uint8_t *p_data, uint8_t length);
+HAL_StatusTypeDef MCP7940M_TxnQueueWriteRegister(MCP7940M_TxnList *p_list, uint8_t reg, uint8_t data);
+HAL_StatusTypeDef MCP7940M_TxnExecute(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list);
+HAL_StatusTypeDef MCP7940M_TxnExecute_IT(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback);
+HAL_StatusTypeDef MCP7940M_TxnExecute_DMA(MCP7940M *p_mcp7940m, MCP7940M_TxnList *p_list, MCP7940M_Callback callback);
+
+/*
+ * ALARMS
+ */
+HAL_StatusTypeDef MCP7940M_SetAlarm(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, const MCP7940M_Alarm *p_alarm);
+HAL_StatusTypeDef MCP7940M_EnableAlarm(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, uint8_t enable);
+HAL_StatusTypeDef MCP7940M_SetAlarmPolarity(MCP7940M *p_mcp7940m, uint8_t activeHigh);
+HAL_StatusTypeDef MCP7940M_GetAlarmFlag(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm, uint8_t *p_flag);
+HAL_StatusTypeDef MCP7940M_ClearAlarmFlag(MCP7940M *p_mcp7940m, MCP7940M_AlarmIndex alarm);
+
+/*
+ * CONTROL AND STATUS BITS
+ */
+HAL_StatusTypeDef MCP7940M_SetHourFormat(MCP7940M *p_mcp7940m, uint8_t twelveHour);
+HAL_StatusTypeDef MCP7940M_GetOscillatorRunning(MCP7940M *p_mcp7940m, uint8_t *p_running);
+HAL_StatusTypeDef MCP7940M_GetLeapYear(MCP7940M *p_mcp7940m, uint8_t *p_leap);
+HAL_StatusTypeDef MCP7940M_GetControl(MCP7940M *p_mcp7940m, uint8_t *p_control);
+HAL_StatusTypeDef MCP7940M_SetOutputLevel(MCP7940M *p_mcp7940m, uint8_t high);
+HAL_StatusTypeDef MCP7940M_SetSquareWave(MCP7940M *p_mcp7940m, uint8_t enable, uint8_t frequency);
+HAL_StatusTypeDef MCP7940M_SetExternalOscillator(MCP7940M *p_mcp7940m, uint8_t enable);
+
+/*
+ * CALIBRATION
+ */
+HAL_StatusTypeDef MCP7940M_SetTrim(MCP7940M *p_mcp7940m, int8_t trim);
+HAL_StatusTypeDef MCP7940M_GetTrim(MCP7940M *p_mcp7940m, int8_t *p_trim);
+HAL_StatusTypeDef MCP7940M_AdjustTrim(MCP7940M *p_mcp7940m, int32_t errorPpb);
+HAL_StatusTypeDef MCP7940M_SetCoarseTrim(MCP7940M *p_mcp7940m, uint8_t enable);
+HAL_StatusTypeDef MCP7940M_GetCoarseTrim(MCP7940M *p_mcp7940m, uint8_t *p_enabled);
+HAL_StatusTypeDef MCP7940M_CalibrationStart(MCP7940M *p_mcp7940m, MCP7940M_Calibration *p_cal, uint32_t refHz, uint32_t seconds);
+void MCP7940M_CalibrationEdge(MCP7940M_Calibration *p_cal, uint32_t refTicks);
+void MCP7940M_CalibrationPpsEdge(MCP7940M_Calibration *p_cal, uint32_t refTicks);
+uint8_t MCP7940M_CalibrationDone(const MCP7940M_Calibration *p_cal);
+HAL_StatusTypeDef MCP7940M_CalibrationGetError(const MCP7940M_Calibration *p_cal, int32_t *p_errorPpb);
+HAL_StatusTypeDef MCP7940M_CalibrationApply(MCP7940M *p_mcp7940m, MCP7940M_Calibration *p_cal);
+
+/*
+ * DRIFT MONITOR
+ */
+void MCP7940M_DriftInit(MCP7940M_Drift *p_drift, uint32_t boundMs, uint32_t minInterval, uint32_t maxInterval);
+void MCP7940M_DriftReset(MCP7940M_Drift *p_drift);
+void MCP7940M_DriftAddSample(MCP7940M_Drift *p_drift, uint32_t refEpoch, int32_t offsetMs);
+HAL_StatusTypeDef MCP7940M_DriftMeasure(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift, uint32_t refEpoch, uint16_t refMillis);
+HAL_StatusTypeDef MCP7940M_DriftGetPpb(const MCP7940M_Drift *p_drift, int32_t *p_errorPpb);
+int32_t MCP7940M_DriftPredict(const MCP7940M_Drift *p_drift, uint32_t refEpoch);
+uint32_t MCP7940M_DriftNextSync(const MCP7940M_Drift *p_drift, uint32_t refEpoch);
+HAL_StatusTypeDef MCP7940M_DriftResync(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift, uint32_t refEpoch);
+HAL_StatusTypeDef MCP7940M_DriftApplyTrim(MCP7940M *p_mcp7940m, MCP7940M_Drift *p_drift);
+
+/*
+ * COOPERATIVE TASKS
+ */
+HAL_StatusTypeDef MCP7940M_BeginInit(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, const MCP7940M_Transport *p_transport, void *p_busContext);
+HAL_StatusTypeDef MCP7940M_BeginGetTime(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task);
+HAL_StatusTypeDef MCP7940M_BeginSetTime(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task);
+HAL_StatusTypeDef MCP7940M_BeginSetAlarm(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, MCP7940M_AlarmIndex alarm, const MCP7940M_Alarm *p_alarm);
+HAL_StatusTypeDef MCP7940M_BeginCalibration(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task, MCP7940M_Calibration *p_cal, uint32_t refHz,
+                                            uint32_t seconds);
+HAL_StatusTypeDef MCP7940M_Poll(MCP7940M *p_mcp7940m, MCP7940M_Task *p_task);
+
+/*
+ * SRAM
+ */
+HAL_StatusTypeDef MCP7940M_ReadSram(MCP7940M *p_mcp7940m, uint8_t offset, uint8_t *p_data, uint8_t length);
+HAL_StatusTypeDef MCP7940M_WriteSram(MCP7940M *p_mcp7940m, uint8_t offset, const uint8_t *p_data, uint8_t length);
+HAL_StatusTypeDef MCP7940M_RingFormat(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, uint8_t base, uint8_t slotSize, uint8_t slotCount);
+HAL_StatusTypeDef MCP7940M_RingMount(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, uint8_t base, uint8_t slotSize, uint8_t slotCount);
+HAL_StatusTypeDef MCP7940M_RingAppend(MCP7940M *p_mcp7940m, MCP7940M_SramRing *p_ring, const uint8_t *p_record);
+HAL_StatusTypeDef MCP7940M_RingRead(MCP7940M *p_mcp7940m, const MCP7940M_SramRing *p_ring, uint8_t index, uint8_t *p_record);
+
+/*
+ * REGISTER DUMP
+ */
+HAL_StatusTypeDef MCP7940M_Dump(MCP7940M *p_mcp7940m, uint8_t *p_buffer, uint8_t withSram, uint16_t *p_length);
+uint16_t MCP7940M_DumpParse(const uint8_t *p_data, uint32_t available, MCP7940M_DumpView *p_view);
+
+/*
+ * EVENT CAPTURE
+ */
+void MCP7940M_EventQueueInit(MCP7940M_EventQueue *p_queue, MCP7940M_TimerRead timerRead, uint32_t tickHz);
+uint8_t MCP7940M_EventPush(MCP7940M_EventQueue *p_queue, uint32_t id, uint32_t tick);
+HAL_StatusTypeDef MCP7940M_EventProcess(MCP7940M *p_mcp7940m, MCP7940M_EventQueue *p_queue, MCP7940M_EventHandler handler, void *p_context);
+
+/*
+ * 1 HZ SECOND COUNTER
+ */
+HAL_StatusTypeDef MCP7940M_StartSecondCounter(MCP7940M *p_mcp7940m, MCP7940M_TimerRead timerRead, uint32_t timerHz);
+HAL_StatusTypeDef MCP7940M_StopSecondCounter(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ResyncSecondCounter(MCP7940M *p_mcp7940m);
+void MCP7940M_SecondTickCallback(MCP7940M *p_mcp7940m);
+void MCP7940M_Now(MCP7940M *p_mcp7940m, MCP7940M_Time *p_time, uint32_t *p_subseconds);
+
+/*
+ * BUS TIMING AND RECOVERY
+ */
+HAL_StatusTypeDef MCP7940M_SetBusSpeed(MCP7940M *p_mcp7940m, uint32_t busHz, uint32_t timeoutMargin);
+uint32_t MCP7940M_TransferTimeout(const MCP7940M *p_mcp7940m, uint16_t length);
+void MCP7940M_SetRetries(MCP7940M *p_mcp7940m, uint8_t retries, uint8_t backoffMs);
+void MCP7940M_SetBusRecovery(MCP7940M *p_mcp7940m, MCP7940M_BusRecover busRecover, void *p_context);
+HAL_StatusTypeDef MCP7940M_RecoverBus(MCP7940M *p_mcp7940m);
+#ifndef MCP7940M_NO_HAL
+HAL_StatusTypeDef MCP7940M_HAL_BusRecover(void *p_context);
+#endif
+
+/*
+ * LOW POWER
+ */
+void MCP7940M_SetBusPower(MCP7940M *p_mcp7940m, MCP7940M_BusLock powerUp, MCP7940M_BusLock powerDown, void *p_context);
+HAL_StatusTypeDef MCP7940M_WakeGetTime(MCP7940M *p_mcp7940m, uint32_t maxElapsed);
+#ifndef MCP7940M_NO_HAL
+void MCP7940M_HAL_ClockEnable(void *p_context);
+void MCP7940M_HAL_ClockDisable(void *p_context);
+#endif
+
+#ifdef MCP7940M_ENABLE_STATS
+/*
+ * INSTRUMENTATION
+ */
+void MCP7940M_ResetStats(MCP7940M *p_mcp7940m);
+void MCP7940M_StatsRecord(MCP7940M_CycleStats *p_stats, uint32_t cycles);
+#ifndef MCP7940M_NO_HAL
+void MCP7940M_EnableCycleCounter(void);
+#endif
+#endif
+
 /*
  * LOW LEVEL FUNCTIONS
  */
 HAL_StatusTypeDef MCP7940M_ReadRegister(MCP7940M *mcp7940m, uint8_t reg, uint8_t *data);
 HAL_StatusTypeDef MCP7940M_WriteRegister(MCP7940M *mcp7940m, uint8_t reg, uint8_t data);
+HAL_StatusTypeDef MCP7940M_ReadRegisters(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data, uint16_t length);
+HAL_StatusTypeDef MCP7940M_WriteRegisters(MCP7940M *p_mcp7940m, uint8_t reg, const uint8_t *p_data, uint16_t length);
+
+/*
+ * SHADOW REGISTER CACHE
+ */
+HAL_StatusTypeDef MCP7940M_LoadCache(MCP7940M *p_mcp7940m);
+void MCP7940M_InvalidateCache(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_CacheRead(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t *p_data, uint8_t allowCached);
+HAL_StatusTypeDef MCP7940M_CacheWrite(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t data);
+HAL_StatusTypeDef MCP7940M_UpdateRegister(MCP7940M *p_mcp7940m, uint8_t reg, uint8_t mask, uint8_t value);
+HAL_StatusTypeDef MCP7940M_StageTime(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_Flush(MCP7940M *p_mcp7940m);
 
 /*
  * TIME READ FUNCTIONS
  */
-void MCP7940M_ReadSeconds(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadMinutes(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadHours(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadWeekday(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadDate(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadMonth(MCP7940M *p_mcp7940m);
-void MCP7940M_ReadYear(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadSeconds(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadMinutes(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadHours(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadWeekday(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadDate(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadMonth(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_ReadYear(MCP7940M *p_mcp7940m);
 
 /*
  * TIME WRITE FUNCTIONS
  */
-void MCP7940M_WriteSeconds(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteMinutes(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteHours(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteWeekday(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteDate(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteMonth(MCP7940M *p_mcp7940m);
-void MCP7940M_WriteYear(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteSeconds(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteMinutes(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteHours(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteWeekday(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteDate(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteMonth(MCP7940M *p_mcp7940m);
+HAL_StatusTypeDef MCP7940M_WriteYear(MCP7940M *p_mcp7940m);
 
 /*
  * UTILITY FUNCTIONS
  */
 uint8_t BCDToBinary(uint8_t bcd);
 uint8_t binaryToBCD(uint8_t binary);
+void MCP7940M_BCDDecodeBlock(const uint8_t *p_bcd, uint8_t *p_binary, uint32_t length);
+void MCP7940M_BCDEncodeBlock(const uint8_t *p_binary, uint8_t *p_bcd, uint32_t length);
+void MCP7940M_DecodeTimeBlock(const uint8_t *p_regs, MCP7940M_Time *p_time);
+void MCP7940M_IncrementTime(MCP7940M_Time *p_time);
+uint8_t MCP7940M_TimeValid(const MCP7940M_Time *p_time);
+uint32_t MCP7940M_DaysSince2000(uint8_t date, uint8_t month, uint8_t year);
+uint32_t MCP7940M_TimeToEpoch(const MCP7940M_Time *p_time);
+void MCP7940M_EpochToTime(uint32_t epoch, MCP7940M_Time *p_time);
+void MCP7940M_SnapshotPublish(MCP7940M_Snapshot *p_snapshot, const MCP7940M_Time *p_time, uint32_t timer);
+void MCP7940M_SnapshotRead(const MCP7940M_Snapshot *p_snapshot, MCP7940M_Time *p_time, uint32_t *p_timer);
+MCP7940M_PackedTime MCP7940M_PackTime(const MCP7940M_Time *p_time);
+MCP7940M_PackedTime MCP7940M_PackRegisters(const uint8_t *p_regs);
+void MCP7940M_UnpackTime(MCP7940M_PackedTime packed, MCP7940M_Time *p_time);
+void MCP7940M_UnpackRegisters(MCP7940M_PackedTime packed, uint8_t *p_regs);
+int32_t MCP7940M_PackedDiff(MCP7940M_PackedTime a, MCP7940M_PackedTime b);
+
+/*
+ * BCD KERNELS
+ * Branch and divide free, valid for 00..99.
+ */
+static inline uint8_t MCP7940M_BCDDecode(uint8_t bcd)
+{
+    return (uint8_t)(bcd - (bcd >> 4) * 6); // 16 * tens + ones - 6 * tens
+}
+
+static inline uint8_t MCP7940M_BCDEncode(uint8_t binary)
+{
+    return (uint8_t)(binary + ((binary * 205) >> 11) * 6); // (binary * 205) >> 11 == binary / 10
+}
+
+/*
+ * HOUR FORMAT
+ * RTCHOUR and ALMxHOUR hold 00..23, or 1..12 with the PM bit when 12/24 is
+ * set. The driver always works with 00..23.
+ */
+static inline uint8_t MCP7940M_DecodeHours(uint8_t reg)
+{
+    if (reg & MCP7940M_RTCHOUR_12_24)
+    {
+        return (uint8_t)(MCP7940M_BCDDecode(reg & 0b00011111) % 12 + ((reg & MCP7940M_RTCHOUR_PM) ? 12 : 0));
+    }
+    return MCP7940M_BCDDecode(reg & 0b00111111);
+}
+
+static inline uint8_t MCP7940M_EncodeHours(uint8_t hours, uint8_t twelveHour)
+{
+    if (twelveHour)
+    {
+        return (uint8_t)(MCP7940M_BCDEncode((hours % 12) ? (hours % 12) : 12) | MCP7940M_RTCHOUR_12_24 |
+                         ((hours >= 12) ? MCP7940M_RTCHOUR_PM : 0));
+    }
+    return MCP7940M_BCDEncode(hours);
+}
+
+/*
+ * WEEKDAY FORMAT
+ * RTCWKDAY and ALMxWKDAY count 1..7 and wrap from 7 to 1, the Weekday enum
+ * counts 0..6. 0 is not a valid register value and is read as day 1.
+ */
+static inline Weekday MCP7940M_DecodeWeekday(uint8_t reg)
+{
+    reg &= 0b00000111;
+    return (reg == 0) ? MONDAY : (Weekday)(reg - 1);
+}
+
+static inline uint8_t MCP7940M_EncodeWeekday(Weekday weekday)
+{
+    return (uint8_t)(weekday + 1);
+}
+
+/*
+ * PACKED TIME COMPARISON
+ */
+static inline int MCP7940M_PackedCompare(MCP7940M_PackedTime a, MCP7940M_PackedTime b)
+{
+    return (a > b) - (a < b);
+}
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* INC_MCP7940M_H_ */
@@ -0,0 +1,356 @@
+/*
+ * MCP7940M.hpp
+ *
+ * This file contains a header-only C++17 layer over the MCP7940M driver.
+ * Registers and their fields are types, the BCD and time codecs are constexpr
+ * and the bus is a template parameter, so a burst read and its decode inline
+ * into the caller and nothing that is not used is instantiated.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INC_MCP7940M_HPP_
+#define INC_MCP7940M_HPP_
+
+#include "MCP7940M.h"
+
+namespace mcp7940m
+{
+
+/*
+ * BCD CODECS
+ * The same branch and divide free kernels as MCP7940M_BCDDecode/Encode.
+ */
+constexpr uint8_t bcdDecode(uint8_t bcd)
+{
+    return static_cast<uint8_t>(bcd - (bcd >> 4) * 6);
+}
+
+constexpr uint8_t bcdEncode(uint8_t binary)
+{
+    return static_cast<uint8_t>(binary + ((binary * 205) >> 11) * 6);
+}
+
+static_assert(bcdDecode(0x59) == 59 && bcdDecode(0x99) == 99, "BCD decode");
+static_assert(bcdEncode(59) == 0x59 && bcdEncode(99) == 0x99, "BCD encode");
+
+/*
+ * REGISTER MAP
+ * A field is a register address and the mask of its bits. get/set move the
+ * field to and from bit 0, BCD fields decode/encode their value.
+ */
+constexpr uint8_t lowestBit(uint8_t mask)
+{
+    uint8_t shift = 0;
+    while (mask != 0 && (mask & 1) == 0)
+    {
+        mask >>= 1;
+        shift++;
+    }
+    return shift;
+}
+
+template <uint8_t Address, uint8_t Mask = 0xFF> struct Register
+{
+    static_assert(Mask != 0, "a field needs at least one bit");
+
+    static constexpr uint8_t address = Address;
+    static constexpr uint8_t mask = Mask;
+    static constexpr uint8_t shift = lowestBit(Mask);
+
+    static constexpr uint8_t get(uint8_t raw)
+    {
+        return static_cast<uint8_t>((raw & mask) >> shift);
+    }
+
+    static constexpr uint8_t set(uint8_t raw, uint8_t value)
+    {
+        return static_cast<uint8_t>((raw & ~mask) | ((value << shift) & mask));
+    }
+
+    static constexpr uint8_t decode(uint8_t raw)
+    {
+        return get(raw);
+    }
+
+    static constexpr uint8_t encode(uint8_t raw, uint8_t value)
+    {
+        return set(raw, value);
+    }
+};
+
+template <uint8_t Address, uint8_t Mask> struct BcdRegister : Register<Address, Mask>
+{
+    static constexpr uint8_t decode(uint8_t raw)
+    {
+        return bcdDecode(raw & Mask);
+    }
+
+    static constexpr uint8_t encode(uint8_t raw, uint8_t value)
+    {
+        return static_cast<uint8_t>((raw & ~Mask) | (bcdEncode(value) & Mask));
+    }
+};
+
+/* RTCHOUR and ALMxHOUR, 00..23 in both hour formats. encode keeps the format in raw. */
+template <uint8_t Address> struct HourRegister : Register<Address, 0b01111111>
+{
+    static constexpr uint8_t decode(uint8_t raw)
+    {
+        return (raw & MCP7940M_RTCHOUR_12_24)
+                   ? static_cast<uint8_t>(bcdDecode(raw & 0b00011111) % 12 + ((raw & MCP7940M_RTCHOUR_PM) ? 12 : 0))
+                   : bcdDecode(raw & 0b00111111);
+    }
+
+    static constexpr uint8_t encode(uint8_t raw, uint8_t hours)
+    {
+        return (raw & MCP7940M_RTCHOUR_12_24)
+                   ? static_cast<uint8_t>(bcdEncode((hours % 12) ? (hours % 12) : 12) | MCP7940M_RTCHOUR_12_24 |
+                                          ((hours >= 12) ? MCP7940M_RTCHOUR_PM : 0))
+                   : bcdEncode(hours);
+    }
+};
+
+/* RTCWKDAY and ALMxWKDAY, 1..7 in the register and Weekday 0..6 here. */
+template <uint8_t Address> struct WeekdayRegister : Register<Address, 0b00000111>
+{
+    static constexpr uint8_t decode(uint8_t raw)
+    {
+        return ((raw & 0b00000111) == 0) ? 0 : static_cast<uint8_t>((raw & 0b00000111) - 1);
+    }
+
+    static constexpr uint8_t encode(uint8_t raw, uint8_t weekday)
+    {
+        return static_cast<uint8_t>((raw & ~0b00000111) | ((weekday + 1) & 0b00000111));
+    }
+};
+
+namespace reg
+{
+using Seconds = BcdRegister<MCP7940M_REG_RTCSEC, 0b01111111>;
+using Start = Register<MCP7940M_REG_RTCSEC, MCP7940M_RTCSEC_ST>;
+using Minutes = BcdRegister<MCP7940M_REG_RTCMIN, 0b01111111>;
+using Hours = HourRegister<MCP7940M_REG_RTCHOUR>;
+using TwelveHour = Register<MCP7940M_REG_RTCHOUR, MCP7940M_RTCHOUR_12_24>; // Read only here, MCP7940M_SetHourFormat converts the hour
+using Weekday = WeekdayRegister<MCP7940M_REG_RTCWKDAY>;
+using OscillatorRunning = Register<MCP7940M_REG_RTCWKDAY, MCP7940M_RTCWKDAY_OSCRUN>;
+using Date = BcdRegister<MCP7940M_REG_RTCDATE, 0b00111111>;
+using Month = BcdRegister<MCP7940M_REG_RTCMTH, 0b00011111>;
+using LeapYear = Register<MCP7940M_REG_RTCMTH, MCP7940M_RTCMTH_LP>;
+using Year = BcdRegister<MCP7940M_REG_RTCYEAR, 0xFF>;
+
+using Output = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_OUT>;
+using SquareWave = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN>;
+using Alarm1Enable = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_ALM1EN>;
+using Alarm0Enable = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_ALM0EN>;
+using ExternalOscillator = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_EXTOSC>;
+using CoarseTrim = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_CRSTRIM>;
+using SquareWaveFrequency = Register<MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWFS>;
+
+using TrimSign = Register<MCP7940M_REG_OSCTRIM, MCP7940M_OSCTRIM_SIGN>;
+using TrimValue = Register<MCP7940M_REG_OSCTRIM, MCP7940M_OSCTRIM_TRIMVAL>;
+} // namespace reg
+
+/*
+ * TIME BLOCK CODECS
+ * RTCSEC..RTCYEAR to and from MCP7940M_Time, usable in constant expressions.
+ */
+constexpr MCP7940M_Time decodeTime(const uint8_t *p_regs)
+{
+    return MCP7940M_Time{reg::Seconds::decode(p_regs[0]), reg::Minutes::decode(p_regs[1]),
+                         reg::Hours::decode(p_regs[2]),   static_cast<Weekday>(reg::Weekday::decode(p_regs[3])),
+                         reg::Date::decode(p_regs[4]),    reg::Month::decode(p_regs[5]),
+                         reg::Year::decode(p_regs[6])};
+}
+
+/* ST is set, twelveHour selects the hour format, OSCRUN and LP are read only and written 0. */
+constexpr void encodeTime(const MCP7940M_Time &time, uint8_t *p_regs, bool twelveHour)
+{
+    p_regs[0] = static_cast<uint8_t>(bcdEncode(time.seconds) | MCP7940M_RTCSEC_ST);
+    p_regs[1] = bcdEncode(time.minutes);
+    p_regs[2] = reg::Hours::encode(twelveHour ? MCP7940M_RTCHOUR_12_24 : 0, time.hours);
+    p_regs[3] = reg::Weekday::encode(0, static_cast<uint8_t>(time.weekday));
+    p_regs[4] = bcdEncode(time.date);
+    p_regs[5] = bcdEncode(time.month);
+    p_regs[6] = bcdEncode(time.year);
+}
+
+namespace detail
+{
+constexpr bool codecRoundTrip()
+{
+    uint8_t regs[MCP7940M_TIME_REG_COUNT] = {};
+    encodeTime(MCP7940M_Time{59, 59, 23, FRIDAY, 31, 12, 99}, regs, true);
+    MCP7940M_Time time = decodeTime(regs);
+    return regs[2] == 0x71 && regs[3] == 5 && time.seconds == 59 && time.minutes == 59 && time.hours == 23 && time.weekday == FRIDAY &&
+           time.date == 31 && time.month == 12 && time.year == 99;
+}
+static_assert(codecRoundTrip(), "time block codec");
+} // namespace detail
+
+/*
+ * BUS POLICIES
+ * A bus provides
+ *     HAL_StatusTypeDef read(uint8_t reg, uint8_t *p_data, uint16_t length);
+ *     HAL_StatusTypeDef write(uint8_t reg, const uint8_t *p_data, uint16_t length);
+ * Device calls them directly, so a bus whose functions are visible inlines
+ * completely and only pays for what it does.
+ */
+
+/* Goes through the C driver: bus lock, retries, recovery, shadow cache and stats. */
+class DriverBus
+{
+  public:
+    explicit constexpr DriverBus(MCP7940M &mcp7940m) : p_mcp7940m(&mcp7940m)
+    {
+    }
+
+    HAL_StatusTypeDef read(uint8_t reg, uint8_t *p_data, uint16_t length)
+    {
+        return MCP7940M_ReadRegisters(p_mcp7940m, reg, p_data, length);
+    }
+
+    HAL_StatusTypeDef write(uint8_t reg, const uint8_t *p_data, uint16_t length)
+    {
+        return MCP7940M_WriteRegisters(p_mcp7940m, reg, p_data, length);
+    }
+
+  private:
+    MCP7940M *p_mcp7940m;
+};
+
+#ifndef MCP7940M_NO_HAL
+/* Calls the HAL directly, no transport indirection, no locking and no retries. */
+template <uint32_t Timeout = MCP7940M_TIMEOUT_MARGIN + 2> class HalBus
+{
+  public:
+    explicit constexpr HalBus(I2C_HandleTypeDef &i2cHandle) : p_i2cHandle(&i2cHandle)
+    {
+    }
+
+    HAL_StatusTypeDef read(uint8_t reg, uint8_t *p_data, uint16_t length)
+    {
+        return HAL_I2C_Mem_Read(p_i2cHandle, MCP7940M_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, p_data, length, Timeout);
+    }
+
+    HAL_StatusTypeDef write(uint8_t reg, const uint8_t *p_data, uint16_t length)
+    {
+        return HAL_I2C_Mem_Write(p_i2cHandle, MCP7940M_I2C_ADDRESS, reg, I2C_MEMADD_SIZE_8BIT, const_cast<uint8_t *>(p_data), length,
+                                 Timeout);
+    }
+
+  private:
+    I2C_HandleTypeDef *p_i2cHandle;
+};
+#endif
+
+/*
+ * DEVICE
+ */
+template <class Bus> class Device
+{
+  public:
+    explicit constexpr Device(Bus bus) : bus(bus)
+    {
+    }
+
+    /**
+     * @brief  Reads one field.
+     * @param  value Receives the decoded field, unchanged on error.
+     * @retval HAL status of the read.
+     */
+    template <class Field> HAL_StatusTypeDef read(uint8_t &value)
+    {
+        uint8_t raw;
+        HAL_StatusTypeDef status = bus.read(Field::address, &raw, 1);
+        if (status == HAL_OK)
+        {
+            value = Field::decode(raw);
+        }
+        return status;
+    }
+
+    /**
+     * @brief  Writes one field, a read-modify-write unless it covers the whole register.
+     * @param  value New field value.
+     * @retval HAL status of the read or write.
+     */
+    template <class Field> HAL_StatusTypeDef write(uint8_t value)
+    {
+        uint8_t raw = 0;
+        if constexpr (Field::mask != 0xFF)
+        {
+            HAL_StatusTypeDef status = bus.read(Field::address, &raw, 1);
+            if (status != HAL_OK)
+            {
+                return status;
+            }
+        }
+        raw = Field::encode(raw, value);
+        return bus.write(Field::address, &raw, 1);
+    }
+
+    /**
+     * @brief  Reads the time as one burst.
+     * @param  time Receives the time, unchanged on error.
+     * @retval HAL status of the read.
+     */
+    HAL_StatusTypeDef getTime(MCP7940M_Time &time)
+    {
+        uint8_t regs[MCP7940M_TIME_REG_COUNT];
+        HAL_StatusTypeDef status = bus.read(MCP7940M_REG_RTCSEC, regs, MCP7940M_TIME_REG_COUNT);
+        if (status == HAL_OK)
+        {
+            time = decodeTime(regs);
+            twelveHour = (regs[2] & MCP7940M_RTCHOUR_12_24) != 0;
+        }
+        return status;
+    }
+
+    /**
+     * @brief  Writes the time as one burst, in the hour format last seen by getTime.
+     * @note   The oscillator keeps running as with MCP7940M_StageTime. Use
+     *         MCP7940M_SetTime for the stop, wait for OSCRUN and restart sequence.
+     * @param  time New time.
+     * @retval HAL status of the write.
+     */
+    HAL_StatusTypeDef writeTime(const MCP7940M_Time &time)
+    {
+        uint8_t regs[MCP7940M_TIME_REG_COUNT];
+        encodeTime(time, regs, twelveHour);
+        return bus.write(MCP7940M_REG_RTCSEC, regs, MCP7940M_TIME_REG_COUNT);
+    }
+
+    Bus &getBus()
+    {
+        return bus;
+    }
+
+  private:
+    Bus bus;
+    bool twelveHour = false;
+};
+
+} // namespace mcp7940m
+
+#endif /* INC_MCP7940M_HPP_ */
@@ -0,0 +1,319 @@
+/*
+ * MCP7940M_LL.c
+ *
+ * This file contains the implementation of a register level I2C transport for the MCP7940M driver on the STM32F4.
+ * The master receiver follows the reference manual (RM0090) sequences for 1, 2 and more bytes.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "MCP7940M_LL.h"
+
+static HAL_StatusTypeDef MCP7940M_LL_WaitSR1(I2C_TypeDef *p_i2c, uint32_t flag, uint32_t *p_polls);
+static HAL_StatusTypeDef MCP7940M_LL_Address(I2C_TypeDef *p_i2c, uint16_t address, uint8_t reg, uint32_t *p_polls);
+static void MCP7940M_LL_Abort(I2C_TypeDef *p_i2c);
+
+/*
+ * TRANSPORT FUNCTIONS
+ */
+
+/**
+ * @brief  Blocking burst read, START + address + register + RESTART + data.
+ * @param  p_context Pointer to a MCP7940M_LL_Bus.
+ * @param  address 8 bit device address.
+ * @param  reg First register.
+ * @param  p_data Receives length bytes.
+ * @param  length Number of bytes.
+ * @param  timeout Budget in ms, converted to status register polls.
+ * @retval HAL_OK, HAL_ERROR on NACK or bus error, HAL_TIMEOUT.
+ */
+static HAL_StatusTypeDef MCP7940M_LL_Read(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    I2C_TypeDef *p_i2c = ((MCP7940M_LL_Bus *)p_context)->instance;
+    uint32_t polls = timeout * MCP7940M_LL_POLLS_PER_MS;
+    uint32_t primask;
+    HAL_StatusTypeDef status;
+
+    if (length == 0)
+    {
+        return HAL_ERROR;
+    }
+
+    status = MCP7940M_LL_Address(p_i2c, address, reg, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    /* Repeated start in receive direction. */
+    p_i2c->CR1 |= I2C_CR1_START;
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_SB, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->DR = (uint8_t)(address | 1);
+
+    if (length == 1)
+    {
+        p_i2c->CR1 &= ~I2C_CR1_ACK;
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_ADDR, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        /* ADDR clear and STOP must not be separated by an interrupt. */
+        primask = __get_PRIMASK();
+        __disable_irq();
+        (void)p_i2c->SR2;
+        p_i2c->CR1 |= I2C_CR1_STOP;
+        __set_PRIMASK(primask);
+
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_RXNE, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        *p_data = (uint8_t)p_i2c->DR;
+        return HAL_OK;
+    }
+
+    if (length == 2)
+    {
+        p_i2c->CR1 |= I2C_CR1_ACK | I2C_CR1_POS;
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_ADDR, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        primask = __get_PRIMASK();
+        __disable_irq();
+        (void)p_i2c->SR2;
+        p_i2c->CR1 &= ~I2C_CR1_ACK;
+        __set_PRIMASK(primask);
+
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_BTF, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        p_i2c->CR1 |= I2C_CR1_STOP;
+        p_data[0] = (uint8_t)p_i2c->DR;
+        p_data[1] = (uint8_t)p_i2c->DR;
+        p_i2c->CR1 &= ~I2C_CR1_POS;
+        return HAL_OK;
+    }
+
+    p_i2c->CR1 |= I2C_CR1_ACK;
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_ADDR, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    (void)p_i2c->SR2;
+
+    for (; length > 3; length--)
+    {
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_RXNE, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        *p_data++ = (uint8_t)p_i2c->DR;
+    }
+
+    /* Data N-2 in DR, data N-1 in the shift register: NACK the last byte. */
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_BTF, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->CR1 &= ~I2C_CR1_ACK;
+    *p_data++ = (uint8_t)p_i2c->DR;
+
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_BTF, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->CR1 |= I2C_CR1_STOP;
+    *p_data++ = (uint8_t)p_i2c->DR;
+
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_RXNE, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    *p_data = (uint8_t)p_i2c->DR;
+    return HAL_OK;
+}
+
+/**
+ * @brief  Blocking burst write, START + address + register + data + STOP.
+ * @param  p_context Pointer to a MCP7940M_LL_Bus.
+ * @param  address 8 bit device address.
+ * @param  reg First register.
+ * @param  p_data length bytes to write.
+ * @param  length Number of bytes.
+ * @param  timeout Budget in ms, converted to status register polls.
+ * @retval HAL_OK, HAL_ERROR on NACK or bus error, HAL_TIMEOUT.
+ */
+static HAL_StatusTypeDef MCP7940M_LL_Write(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    I2C_TypeDef *p_i2c = ((MCP7940M_LL_Bus *)p_context)->instance;
+    uint32_t polls = timeout * MCP7940M_LL_POLLS_PER_MS;
+    HAL_StatusTypeDef status;
+
+    status = MCP7940M_LL_Address(p_i2c, address, reg, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+
+    for (; length > 0; length--)
+    {
+        status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_TXE, &polls);
+        if (status != HAL_OK)
+        {
+            return status;
+        }
+        p_i2c->DR = *p_data++;
+    }
+
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_BTF, &polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->CR1 |= I2C_CR1_STOP;
+    return HAL_OK;
+}
+
+static uint32_t MCP7940M_LL_GetTick(void *p_context)
+{
+    return ((MCP7940M_LL_Bus *)p_context)->getTick();
+}
+
+/* Register level transport, the bus context is a MCP7940M_LL_Bus. Blocking transfers only. */
+const MCP7940M_Transport MCP7940M_LL_Transport = {
+    .read = MCP7940M_LL_Read,
+    .write = MCP7940M_LL_Write,
+    .readAsync = NULL,
+    .writeAsync = NULL,
+    .getTick = MCP7940M_LL_GetTick,
+};
+
+/*
+ * HELPERS
+ */
+
+/**
+ * @brief  Polls SR1 for a flag within the remaining poll budget.
+ * @param  p_i2c I2C peripheral.
+ * @param  flag SR1 flag to wait for.
+ * @param  p_polls Remaining polls, shared by every wait of a transfer.
+ * @retval HAL_OK when set, HAL_ERROR on NACK or bus error (the transfer is
+ *         aborted), HAL_TIMEOUT when the budget is used up.
+ */
+static HAL_StatusTypeDef MCP7940M_LL_WaitSR1(I2C_TypeDef *p_i2c, uint32_t flag, uint32_t *p_polls)
+{
+    uint32_t sr1;
+
+    for (;;)
+    {
+        sr1 = p_i2c->SR1;
+        if (sr1 & flag)
+        {
+            return HAL_OK;
+        }
+        if (sr1 & (I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO))
+        {
+            MCP7940M_LL_Abort(p_i2c);
+            return HAL_ERROR;
+        }
+        if (*p_polls == 0)
+        {
+            MCP7940M_LL_Abort(p_i2c);
+            return HAL_TIMEOUT;
+        }
+        (*p_polls)--;
+    }
+}
+
+/**
+ * @brief  Sends START, the write address and the register pointer.
+ * @param  p_i2c I2C peripheral.
+ * @param  address 8 bit device address.
+ * @param  reg Register pointer.
+ * @param  p_polls Remaining polls.
+ * @retval HAL_OK, HAL_TIMEOUT if the bus stays busy, otherwise the wait status.
+ */
+static HAL_StatusTypeDef MCP7940M_LL_Address(I2C_TypeDef *p_i2c, uint16_t address, uint8_t reg, uint32_t *p_polls)
+{
+    HAL_StatusTypeDef status;
+
+    while (p_i2c->SR2 & I2C_SR2_BUSY)
+    {
+        if (*p_polls == 0)
+        {
+            return HAL_TIMEOUT; // Stuck bus, lets the driver run its bus recovery.
+        }
+        (*p_polls)--;
+    }
+
+    p_i2c->CR1 &= ~I2C_CR1_POS;
+    p_i2c->CR1 |= I2C_CR1_START;
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_SB, p_polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->DR = (uint8_t)(address & ~1);
+
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_ADDR, p_polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    (void)p_i2c->SR2; // SR1 then SR2 read clears ADDR.
+
+    status = MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_TXE, p_polls);
+    if (status != HAL_OK)
+    {
+        return status;
+    }
+    p_i2c->DR = reg;
+
+    return MCP7940M_LL_WaitSR1(p_i2c, I2C_SR1_TXE, p_polls);
+}
+
+/**
+ * @brief  Releases the bus after an error and clears the error flags.
+ * @param  p_i2c I2C peripheral.
+ */
+static void MCP7940M_LL_Abort(I2C_TypeDef *p_i2c)
+{
+    p_i2c->CR1 |= I2C_CR1_STOP;
+    p_i2c->SR1 &= ~(I2C_SR1_AF | I2C_SR1_BERR | I2C_SR1_ARLO);
+    p_i2c->CR1 &= ~(I2C_CR1_ACK | I2C_CR1_POS);
+}
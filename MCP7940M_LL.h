@@ -0,0 +1,68 @@
+/*
+ * MCP7940M_LL.h
+ *
+ * This file contains the declarations of a register level I2C transport for the MCP7940M driver on the STM32F4.
+ * It drives the I2C peripheral directly, without the HAL state checks, locking and tick based timeouts,
+ * and serves the blocking burst transfers of the driver.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INC_MCP7940M_LL_H_
+#define INC_MCP7940M_LL_H_
+
+#include "MCP7940M.h"
+
+#ifndef MCP7940M_LL_DEVICE_HEADER
+#define MCP7940M_LL_DEVICE_HEADER "stm32f4xx.h"
+#endif
+#include MCP7940M_LL_DEVICE_HEADER /* Needed for I2C_TypeDef and the register bits */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DEFINES
+ */
+#define MCP7940M_LL_POLLS_PER_MS 10000 /* Status register polls per ms of transport timeout */
+
+/*
+ * BUS CONTEXT
+ */
+typedef struct
+{
+    I2C_TypeDef *instance;    /* Peripheral configured as master, e.g. by HAL_I2C_Init at startup */
+    uint32_t (*getTick)(void); /* Millisecond tick, only used by the driver for the OSCRUN wait */
+} MCP7940M_LL_Bus;
+
+/*
+ * TRANSPORT
+ */
+extern const MCP7940M_Transport MCP7940M_LL_Transport;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_MCP7940M_LL_H_ */
@@ -0,0 +1,339 @@
+/*
+ * MCP7940M_Sim.c
+ *
+ * This file contains the implementation of a simulated MCP7940M for host builds of the driver.
+ * Build with MCP7940M_NO_HAL and install it with MCP7940M_InitTransport(&mcp7940m, &MCP7940M_Sim_Transport, &sim).
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "MCP7940M_Sim.h"
+
+#include <string.h>
+
+static HAL_StatusTypeDef MCP7940M_Sim_Transfer(MCP7940M_Sim *p_sim, uint8_t write, uint8_t reg, uint8_t *p_read, const uint8_t *p_write, uint16_t length);
+static void MCP7940M_Sim_Store(MCP7940M_Sim *p_sim, uint8_t reg, uint8_t data);
+static void MCP7940M_Sim_Charge(MCP7940M_Sim *p_sim, uint32_t bytes, uint32_t extraBits);
+static void MCP7940M_Sim_Tick(MCP7940M_Sim *p_sim);
+
+/*
+ * FUNCTIONS
+ */
+
+/**
+ * @brief  Powers up the simulated chip: register map cleared, oscillator stopped.
+ * @param  p_sim Pointer to the simulation.
+ * @param  busHz SCL frequency the transfers are charged at.
+ */
+void MCP7940M_SimInit(MCP7940M_Sim *p_sim, uint32_t busHz)
+{
+    memset(p_sim, 0, sizeof(*p_sim));
+    p_sim->busHz = (busHz != 0) ? busHz : MCP7940M_DEFAULT_BUS_HZ;
+    p_sim->memory[MCP7940M_REG_RTCDATE] = 0x01;
+    p_sim->memory[MCP7940M_REG_RTCMTH] = 0x01;
+    p_sim->failStatus = HAL_OK;
+}
+
+/**
+ * @brief  Loads a time into the timekeeping registers without charging the bus.
+ * @param  p_sim Pointer to the simulation.
+ * @param  p_time Time to load.
+ * @param  running 1 to start the oscillator.
+ */
+void MCP7940M_SimSetTime(MCP7940M_Sim *p_sim, const MCP7940M_Time *p_time, uint8_t running)
+{
+    uint8_t *p_regs = p_sim->memory;
+
+    p_regs[MCP7940M_REG_RTCSEC] = MCP7940M_BCDEncode(p_time->seconds) | (running ? MCP7940M_RTCSEC_ST : 0);
+    p_regs[MCP7940M_REG_RTCMIN] = MCP7940M_BCDEncode(p_time->minutes);
+    p_regs[MCP7940M_REG_RTCHOUR] = MCP7940M_BCDEncode(p_time->hours);
+    p_regs[MCP7940M_REG_RTCWKDAY] = MCP7940M_EncodeWeekday(p_time->weekday) | (running ? MCP7940M_RTCWKDAY_OSCRUN : 0);
+    p_regs[MCP7940M_REG_RTCDATE] = MCP7940M_BCDEncode(p_time->date);
+    p_regs[MCP7940M_REG_RTCMTH] = MCP7940M_BCDEncode(p_time->month) | ((p_time->year % 4 == 0) ? MCP7940M_RTCMTH_LP : 0);
+    p_regs[MCP7940M_REG_RTCYEAR] = MCP7940M_BCDEncode(p_time->year);
+    p_sim->secondMicros = 0;
+}
+
+/**
+ * @brief  Lets simulated time pass, counting seconds while the oscillator runs.
+ * @param  p_sim Pointer to the simulation.
+ * @param  micros Microseconds to advance.
+ */
+void MCP7940M_SimAdvance(MCP7940M_Sim *p_sim, uint64_t micros)
+{
+    p_sim->micros += micros;
+    if (!(p_sim->memory[MCP7940M_REG_RTCSEC] & MCP7940M_RTCSEC_ST))
+    {
+        return;
+    }
+
+    micros += p_sim->secondMicros;
+    while (micros >= 1000000ULL)
+    {
+        MCP7940M_Sim_Tick(p_sim);
+        micros -= 1000000ULL;
+    }
+    p_sim->secondMicros = (uint32_t)micros;
+}
+
+/**
+ * @brief  Clears the bus counters.
+ * @param  p_sim Pointer to the simulation.
+ */
+void MCP7940M_SimResetStats(MCP7940M_Sim *p_sim)
+{
+    memset(&p_sim->stats, 0, sizeof(p_sim->stats));
+}
+
+/**
+ * @brief  Makes the next transfers fail without touching the registers.
+ * @param  p_sim Pointer to the simulation.
+ * @param  count Number of transfers to fail.
+ * @param  status Status they return, e.g. HAL_ERROR for a NACK.
+ */
+void MCP7940M_SimFail(MCP7940M_Sim *p_sim, uint32_t count, HAL_StatusTypeDef status)
+{
+    p_sim->failCount = count;
+    p_sim->failStatus = status;
+}
+
+/**
+ * @brief  Reports a finished asynchronous transfer to the driver, i.e. runs its interrupt.
+ * @note   Call in a loop until it returns 0 to run multi-step operations to the end.
+ * @param  p_sim Pointer to the simulation.
+ * @param  p_mcp7940m Driver instance that started the transfer.
+ * @retval 1 if a completion was delivered, 0 if none was pending.
+ */
+uint8_t MCP7940M_SimService(MCP7940M_Sim *p_sim, MCP7940M *p_mcp7940m)
+{
+    if (!p_sim->pending)
+    {
+        return 0;
+    }
+    p_sim->pending = 0;
+    MCP7940M_TransferComplete(p_mcp7940m, p_sim->pendingStatus);
+    return 1;
+}
+
+/*
+ * TRANSPORT FUNCTIONS
+ */
+static HAL_StatusTypeDef MCP7940M_Sim_Read(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    (void)address;
+    (void)timeout;
+    return MCP7940M_Sim_Transfer((MCP7940M_Sim *)p_context, 0, reg, p_data, NULL, length);
+}
+
+static HAL_StatusTypeDef MCP7940M_Sim_Write(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint32_t timeout)
+{
+    (void)address;
+    (void)timeout;
+    return MCP7940M_Sim_Transfer((MCP7940M_Sim *)p_context, 1, reg, NULL, p_data, length);
+}
+
+static HAL_StatusTypeDef MCP7940M_Sim_ReadAsync(void *p_context, uint16_t address, uint8_t reg, uint8_t *p_data, uint16_t length, uint8_t dma)
+{
+    MCP7940M_Sim *p_sim = (MCP7940M_Sim *)p_context;
+
+    (void)address;
+    (void)dma;
+    if (p_sim->pending)
+    {
+        return HAL_BUSY;
+    }
+    p_sim->pendingStatus = MCP7940M_Sim_Transfer(p_sim, 0, reg, p_data, NULL, length);
+    p_sim->pending = 1;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef MCP7940M_Sim_WriteAsync(void *p_context, uint16_t address, uint8_t reg, const uint8_t *p_data, uint16_t length, uint8_t dma)
+{
+    MCP7940M_Sim *p_sim = (MCP7940M_Sim *)p_context;
+
+    (void)address;
+    (void)dma;
+    if (p_sim->pending)
+    {
+        return HAL_BUSY;
+    }
+    p_sim->pendingStatus = MCP7940M_Sim_Transfer(p_sim, 1, reg, NULL, p_data, length);
+    p_sim->pending = 1;
+    return HAL_OK;
+}
+
+/* Each call lets 1 µs pass, so busy waits on the tick terminate. */
+static uint32_t MCP7940M_Sim_GetTick(void *p_context)
+{
+    MCP7940M_Sim *p_sim = (MCP7940M_Sim *)p_context;
+
+    MCP7940M_SimAdvance(p_sim, 1);
+    return (uint32_t)(p_sim->micros / 1000ULL);
+}
+
+const MCP7940M_Transport MCP7940M_Sim_Transport = {
+    .read = MCP7940M_Sim_Read,
+    .write = MCP7940M_Sim_Write,
+    .readAsync = MCP7940M_Sim_ReadAsync,
+    .writeAsync = MCP7940M_Sim_WriteAsync,
+    .getTick = MCP7940M_Sim_GetTick,
+};
+
+/*
+ * SIMULATION
+ */
+
+/**
+ * @brief  Runs one transaction against the register file and charges its wire time.
+ * @note   A read is START, address, register, RESTART, address, data, STOP.
+ *         A write is START, address, register, data, STOP.
+ * @param  p_sim Pointer to the simulation.
+ * @param  write 1 for a write from p_write, 0 for a read into p_read.
+ * @param  reg First register, auto-incremented.
+ * @param  p_read Receives the data of a read.
+ * @param  p_write Data of a write.
+ * @param  length Number of data bytes.
+ * @retval HAL_OK, HAL_ERROR beyond the end of SRAM or for an injected fault.
+ */
+static HAL_StatusTypeDef MCP7940M_Sim_Transfer(MCP7940M_Sim *p_sim, uint8_t write, uint8_t reg, uint8_t *p_read, const uint8_t *p_write, uint16_t length)
+{
+    uint16_t i;
+
+    if (p_sim->failCount > 0)
+    {
+        p_sim->failCount--;
+        MCP7940M_Sim_Charge(p_sim, 1, 2); // NACK of the address byte.
+        return p_sim->failStatus;
+    }
+    if (length == 0 || (uint16_t)reg + length > MCP7940M_SIM_MEMORY_SIZE)
+    {
+        return HAL_ERROR;
+    }
+
+    if (write)
+    {
+        for (i = 0; i < length; i++)
+        {
+            MCP7940M_Sim_Store(p_sim, (uint8_t)(reg + i), p_write[i]);
+        }
+        p_sim->stats.writes++;
+        MCP7940M_Sim_Charge(p_sim, length + 2U, 2);
+    }
+    else
+    {
+        memcpy(p_read, &p_sim->memory[reg], length);
+        p_sim->stats.reads++;
+        MCP7940M_Sim_Charge(p_sim, length + 3U, 3);
+    }
+    return HAL_OK;
+}
+
+/**
+ * @brief  Writes one register the way the chip does.
+ * @note   OSCRUN and LP are read-only. OSCRUN follows ST without the real
+ *         oscillator start-up delay.
+ * @param  p_sim Pointer to the simulation.
+ * @param  reg Register to write.
+ * @param  data Written value.
+ */
+static void MCP7940M_Sim_Store(MCP7940M_Sim *p_sim, uint8_t reg, uint8_t data)
+{
+    uint8_t *p_regs = p_sim->memory;
+
+    switch (reg)
+    {
+    case MCP7940M_REG_RTCSEC:
+        p_regs[reg] = data;
+        p_regs[MCP7940M_REG_RTCWKDAY] &= (uint8_t)~MCP7940M_RTCWKDAY_OSCRUN;
+        if (data & MCP7940M_RTCSEC_ST)
+        {
+            p_regs[MCP7940M_REG_RTCWKDAY] |= MCP7940M_RTCWKDAY_OSCRUN;
+        }
+        break;
+
+    case MCP7940M_REG_RTCWKDAY:
+        p_regs[reg] = (data & (uint8_t)~MCP7940M_RTCWKDAY_OSCRUN) | (p_regs[reg] & MCP7940M_RTCWKDAY_OSCRUN);
+        break;
+
+    case MCP7940M_REG_RTCMTH:
+        p_regs[reg] = (data & (uint8_t)~MCP7940M_RTCMTH_LP) | (p_regs[reg] & MCP7940M_RTCMTH_LP);
+        break;
+
+    case MCP7940M_REG_RTCYEAR:
+        p_regs[reg] = data;
+        p_regs[MCP7940M_REG_RTCMTH] &= (uint8_t)~MCP7940M_RTCMTH_LP;
+        if (MCP7940M_BCDDecode(data) % 4 == 0)
+        {
+            p_regs[MCP7940M_REG_RTCMTH] |= MCP7940M_RTCMTH_LP;
+        }
+        break;
+
+    default:
+        p_regs[reg] = data;
+        break;
+    }
+}
+
+/**
+ * @brief  Counts a transaction and advances simulated time by its wire time.
+ * @param  p_sim Pointer to the simulation.
+ * @param  bytes Bytes of the transaction, 9 SCL periods each with the ACK.
+ * @param  extraBits START, RESTART and STOP conditions.
+ */
+static void MCP7940M_Sim_Charge(MCP7940M_Sim *p_sim, uint32_t bytes, uint32_t extraBits)
+{
+    uint64_t bits = (uint64_t)bytes * 9U + extraBits;
+    uint64_t micros = (bits * 1000000ULL + p_sim->busHz - 1) / p_sim->busHz;
+
+    p_sim->stats.transactions++;
+    p_sim->stats.bytes += bytes;
+    p_sim->stats.busMicros += micros;
+    MCP7940M_SimAdvance(p_sim, micros);
+}
+
+/**
+ * @brief  Advances the timekeeping registers by one second.
+ * @note   WKDAY counts on its own like the chip's, 1..7 and 7 wraps to 1.
+ * @param  p_sim Pointer to the simulation.
+ */
+static void MCP7940M_Sim_Tick(MCP7940M_Sim *p_sim)
+{
+    uint8_t *p_regs = p_sim->memory;
+    uint8_t wkday = p_regs[MCP7940M_REG_RTCWKDAY] & 0b00000111;
+    MCP7940M_Time time;
+
+    MCP7940M_DecodeTimeBlock(p_regs, &time);
+    MCP7940M_IncrementTime(&time);
+    if (time.hours == 0 && time.minutes == 0 && time.seconds == 0)
+    {
+        wkday = (wkday >= 7) ? 1 : wkday + 1;
+    }
+
+    p_regs[MCP7940M_REG_RTCSEC] = MCP7940M_BCDEncode(time.seconds) | (p_regs[MCP7940M_REG_RTCSEC] & MCP7940M_RTCSEC_ST);
+    p_regs[MCP7940M_REG_RTCMIN] = MCP7940M_BCDEncode(time.minutes);
+    p_regs[MCP7940M_REG_RTCHOUR] = MCP7940M_EncodeHours(time.hours, p_regs[MCP7940M_REG_RTCHOUR] & MCP7940M_RTCHOUR_12_24);
+    p_regs[MCP7940M_REG_RTCWKDAY] = wkday | (p_regs[MCP7940M_REG_RTCWKDAY] & 0b11111000);
+    p_regs[MCP7940M_REG_RTCDATE] = MCP7940M_BCDEncode(time.date);
+    p_regs[MCP7940M_REG_RTCMTH] = MCP7940M_BCDEncode(time.month) | ((time.year % 4 == 0) ? MCP7940M_RTCMTH_LP : 0);
+    p_regs[MCP7940M_REG_RTCYEAR] = MCP7940M_BCDEncode(time.year);
+}
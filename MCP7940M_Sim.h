@@ -0,0 +1,96 @@
+/*
+ * MCP7940M_Sim.h
+ *
+ * This file contains the declarations of a simulated MCP7940M for host builds of the driver.
+ * The simulation keeps the register map and SRAM, counts the timekeeping from its own microsecond
+ * clock and charges every transfer its wire time at the configured SCL frequency.
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INC_MCP7940M_SIM_H_
+#define INC_MCP7940M_SIM_H_
+
+#include "MCP7940M.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * DEFINES
+ */
+#define MCP7940M_SIM_MEMORY_SIZE 0x60 /* Register map and SRAM */
+
+/*
+ * BUS COUNTERS
+ */
+typedef struct
+{
+    uint32_t transactions; /* I2C transactions, each START..STOP */
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t bytes;        /* Bytes on the wire including address and register bytes */
+    uint64_t busMicros;    /* Wire time of all transactions */
+} MCP7940M_SimStats;
+
+/*
+ * SIMULATED DEVICE
+ */
+typedef struct
+{
+    uint8_t memory[MCP7940M_SIM_MEMORY_SIZE];
+    uint32_t busHz;
+    uint64_t micros;       /* Simulated time, advanced by every transfer and MCP7940M_SimAdvance */
+    uint32_t secondMicros; /* Progress of the running second */
+    MCP7940M_SimStats stats;
+
+    /* Fault injection: the next failCount transfers return failStatus */
+    uint32_t failCount;
+    HAL_StatusTypeDef failStatus;
+
+    /* Asynchronous transfer done on the bus but not yet reported */
+    uint8_t pending;
+    HAL_StatusTypeDef pendingStatus;
+} MCP7940M_Sim;
+
+/*
+ * FUNCTIONS
+ */
+void MCP7940M_SimInit(MCP7940M_Sim *p_sim, uint32_t busHz);
+void MCP7940M_SimSetTime(MCP7940M_Sim *p_sim, const MCP7940M_Time *p_time, uint8_t running);
+void MCP7940M_SimAdvance(MCP7940M_Sim *p_sim, uint64_t micros);
+void MCP7940M_SimResetStats(MCP7940M_Sim *p_sim);
+void MCP7940M_SimFail(MCP7940M_Sim *p_sim, uint32_t count, HAL_StatusTypeDef status);
+uint8_t MCP7940M_SimService(MCP7940M_Sim *p_sim, MCP7940M *p_mcp7940m);
+
+/*
+ * TRANSPORT
+ */
+extern const MCP7940M_Transport MCP7940M_Sim_Transport;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INC_MCP7940M_SIM_H_ */
@@ -0,0 +1,271 @@
+/*
+ * MCP7940M_Bench.c
+ *
+ * Host microbenchmark of the MCP7940M driver against the simulated chip of MCP7940M_Sim.c.
+ * Reports the bus cost of each operation (transactions, bytes, simulated wire time), the host
+ * cost of the decode kernels and the latency distribution of MCP7940M_GetTime.
+ *
+ * Build from the repository root:
+ *   cc -std=c99 -O2 -DMCP7940M_NO_HAL -I. tools/MCP7940M_Bench.c MCP7940M.c MCP7940M_Sim.c -o mcp7940m_bench
+ * Run:
+ *   ./mcp7940m_bench [busHz]
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "MCP7940M.h"
+#include "MCP7940M_Sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * DEFINES
+ */
+#define BENCH_BUS_ROUNDS 1000       /* Calls per bus cost measurement */
+#define BENCH_DECODE_ROUNDS 10000000 /* Calls per decode kernel measurement */
+#define BENCH_LATENCY_SAMPLES 100000 /* Timed MCP7940M_GetTime calls */
+
+typedef HAL_StatusTypeDef (*BenchOperation)(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim);
+
+static MCP7940M_TxnList benchStartup;
+static uint8_t benchControl;
+static uint8_t benchTrim;
+static volatile uint8_t benchSink;
+
+/*
+ * HELPERS
+ */
+static uint64_t BenchNanos(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static int BenchCompare(const void *p_a, const void *p_b)
+{
+    uint64_t a = *(const uint64_t *)p_a;
+    uint64_t b = *(const uint64_t *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+/*
+ * OPERATIONS
+ */
+static HAL_StatusTypeDef BenchGetTime(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    (void)p_sim;
+    return MCP7940M_GetTime(p_mcp7940m);
+}
+
+static HAL_StatusTypeDef BenchSetTime(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    (void)p_sim;
+    return MCP7940M_SetTime(p_mcp7940m);
+}
+
+static HAL_StatusTypeDef BenchGetEpoch(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    uint32_t epoch;
+
+    (void)p_sim;
+    return MCP7940M_GetEpoch(p_mcp7940m, &epoch);
+}
+
+static HAL_StatusTypeDef BenchWakeGetTime(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    (void)p_sim;
+    return MCP7940M_WakeGetTime(p_mcp7940m, 10);
+}
+
+static HAL_StatusTypeDef BenchStageFlush(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    (void)p_sim;
+    p_mcp7940m->minutes = (uint8_t)((p_mcp7940m->minutes + 1) % 60);
+    MCP7940M_StageTime(p_mcp7940m);
+    return MCP7940M_Flush(p_mcp7940m);
+}
+
+static HAL_StatusTypeDef BenchTxn(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    (void)p_sim;
+    return MCP7940M_TxnExecute(p_mcp7940m, &benchStartup);
+}
+
+static HAL_StatusTypeDef BenchGetTimeIT(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    HAL_StatusTypeDef status = MCP7940M_GetTime_IT(p_mcp7940m, NULL);
+
+    while (MCP7940M_SimService(p_sim, p_mcp7940m))
+    {
+    }
+    if (status == HAL_OK && p_mcp7940m->state != MCP7940M_STATE_READY)
+    {
+        status = HAL_ERROR;
+    }
+    return status;
+}
+
+static HAL_StatusTypeDef BenchSetTimeIT(MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    HAL_StatusTypeDef status = MCP7940M_SetTime_IT(p_mcp7940m, NULL);
+
+    while (MCP7940M_SimService(p_sim, p_mcp7940m))
+    {
+    }
+    if (status == HAL_OK && p_mcp7940m->state != MCP7940M_STATE_READY)
+    {
+        status = HAL_ERROR;
+    }
+    return status;
+}
+
+/*
+ * MEASUREMENTS
+ */
+static void BenchBus(const char *p_name, BenchOperation operation, MCP7940M *p_mcp7940m, MCP7940M_Sim *p_sim)
+{
+    uint32_t failures = 0;
+    uint32_t i;
+
+    MCP7940M_SimResetStats(p_sim);
+    for (i = 0; i < BENCH_BUS_ROUNDS; i++)
+    {
+        if (operation(p_mcp7940m, p_sim) != HAL_OK)
+        {
+            failures++;
+        }
+    }
+
+    printf("%-24s %8.2f %8.2f %10.1f %8lu\n", p_name,
+           (double)p_sim->stats.transactions / BENCH_BUS_ROUNDS,
+           (double)p_sim->stats.bytes / BENCH_BUS_ROUNDS,
+           (double)p_sim->stats.busMicros / BENCH_BUS_ROUNDS,
+           (unsigned long)failures);
+}
+
+static void BenchDecode(void)
+{
+    const uint8_t regs[MCP7940M_RAW_BUFFER_SIZE] = {0xD9, 0x59, 0x23, 0x26, 0x31, 0x12, 0x99, 0x00};
+    MCP7940M_Time time;
+    uint64_t start;
+    uint64_t nanos;
+    uint32_t i;
+
+    start = BenchNanos();
+    for (i = 0; i < BENCH_DECODE_ROUNDS; i++)
+    {
+        MCP7940M_DecodeTimeBlock(regs, &time);
+        benchSink = time.seconds;
+    }
+    nanos = BenchNanos() - start;
+    printf("%-24s %8.2f ns\n", "DecodeTimeBlock", (double)nanos / BENCH_DECODE_ROUNDS);
+
+    start = BenchNanos();
+    for (i = 0; i < BENCH_DECODE_ROUNDS; i++)
+    {
+        benchSink = BCDToBinary((uint8_t)i);
+    }
+    nanos = BenchNanos() - start;
+    printf("%-24s %8.2f ns\n", "BCDToBinary", (double)nanos / BENCH_DECODE_ROUNDS);
+
+    start = BenchNanos();
+    for (i = 0; i < BENCH_DECODE_ROUNDS; i++)
+    {
+        benchSink = (uint8_t)MCP7940M_TimeToEpoch(&time);
+        time.seconds = (uint8_t)(i % 60);
+    }
+    nanos = BenchNanos() - start;
+    printf("%-24s %8.2f ns\n", "TimeToEpoch", (double)nanos / BENCH_DECODE_ROUNDS);
+}
+
+static void BenchLatency(MCP7940M *p_mcp7940m)
+{
+    static uint64_t samples[BENCH_LATENCY_SAMPLES];
+    uint64_t start;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_LATENCY_SAMPLES; i++)
+    {
+        start = BenchNanos();
+        MCP7940M_GetTime(p_mcp7940m);
+        samples[i] = BenchNanos() - start;
+    }
+    qsort(samples, BENCH_LATENCY_SAMPLES, sizeof(samples[0]), BenchCompare);
+
+    printf("GetTime host latency: p50 %llu ns, p90 %llu ns, p99 %llu ns, max %llu ns\n",
+           (unsigned long long)samples[BENCH_LATENCY_SAMPLES / 2],
+           (unsigned long long)samples[BENCH_LATENCY_SAMPLES * 9 / 10],
+           (unsigned long long)samples[BENCH_LATENCY_SAMPLES * 99 / 100],
+           (unsigned long long)samples[BENCH_LATENCY_SAMPLES - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    const MCP7940M_Time start = {.seconds = 50, .minutes = 59, .hours = 23, .weekday = FRIDAY, .date = 31, .month = 12, .year = 24};
+    const MCP7940M_Time noon = {.seconds = 0, .minutes = 0, .hours = 12, .weekday = WEDNESDAY, .date = 1, .month = 1, .year = 25};
+    uint32_t busHz = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 10) : MCP7940M_DEFAULT_BUS_HZ;
+    MCP7940M_Sim sim;
+    MCP7940M mcp7940m;
+
+    MCP7940M_SimInit(&sim, busHz);
+    MCP7940M_SimSetTime(&sim, &start, 1);
+    if (MCP7940M_InitTransport(&mcp7940m, &MCP7940M_Sim_Transport, &sim) != HAL_OK)
+    {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    MCP7940M_SetBusSpeed(&mcp7940m, sim.busHz, MCP7940M_TIMEOUT_MARGIN);
+
+    MCP7940M_TxnInit(&benchStartup);
+    MCP7940M_TxnQueueWriteRegister(&benchStartup, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN);
+    MCP7940M_TxnQueueRead(&benchStartup, MCP7940M_REG_CONTROL, &benchControl, 1);
+    MCP7940M_TxnQueueRead(&benchStartup, MCP7940M_REG_OSCTRIM, &benchTrim, 1);
+
+    printf("Bus cost per call at %lu Hz\n", (unsigned long)sim.busHz);
+    printf("%-24s %8s %8s %10s %8s\n", "operation", "xfers", "bytes", "wire us", "failed");
+    BenchBus("GetTime", BenchGetTime, &mcp7940m, &sim);
+    BenchBus("GetTime_IT", BenchGetTimeIT, &mcp7940m, &sim);
+    BenchBus("GetEpoch", BenchGetEpoch, &mcp7940m, &sim);
+    /* Early in the minute, so the wake read stays within RTCSEC. */
+    MCP7940M_SimSetTime(&sim, &noon, 1);
+    MCP7940M_GetTime(&mcp7940m);
+    BenchBus("WakeGetTime(10 s)", BenchWakeGetTime, &mcp7940m, &sim);
+    BenchBus("SetTime", BenchSetTime, &mcp7940m, &sim);
+    BenchBus("SetTime_IT", BenchSetTimeIT, &mcp7940m, &sim);
+    BenchBus("StageTime + Flush", BenchStageFlush, &mcp7940m, &sim);
+    BenchBus("TxnExecute (startup)", BenchTxn, &mcp7940m, &sim);
+
+    printf("\nHost cost per call\n");
+    BenchDecode();
+
+    printf("\n");
+    BenchLatency(&mcp7940m);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * MCP7940M_DumpDecode.c
+ *
+ * Host decoder for files of MCP7940M register dumps (MCP7940M_Dump), e.g. collected from telemetry.
+ * The file is memory mapped and decoded in batches with the driver's own MCP7940M_DumpParse and
+ * MCP7940M_DecodeTimeBlock, so the tool always agrees with the firmware. Bytes that do not start a
+ * valid dump are skipped until the next one.
+ *
+ * Build from the repository root:
+ *   cc -std=c99 -O2 -DMCP7940M_NO_HAL -I. tools/MCP7940M_DumpDecode.c MCP7940M.c MCP7940M_Sim.c -o mcp7940m_dump
+ * Run:
+ *   ./mcp7940m_dump file          summary of all dumps
+ *   ./mcp7940m_dump -c file       one CSV line per dump
+ *   ./mcp7940m_dump -g N file     write N simulated dumps, for testing and benchmarking
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "MCP7940M.h"
+#include "MCP7940M_Sim.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * DEFINES
+ */
+#define DUMP_BATCH 256        /* Dumps located before each decode pass */
+#define DUMP_SRAM_EVERY 16    /* Generated dumps that include the SRAM, one in N */
+
+typedef struct
+{
+    uint64_t dumps;
+    uint64_t invalid; /* Time fields out of range */
+    uint64_t stopped; /* ST or OSCRUN clear */
+    uint64_t withSram;
+    uint64_t skipped; /* Bytes not belonging to any dump */
+    uint32_t first;
+    uint32_t last;
+    uint32_t earliest;
+    uint32_t latest;
+} DumpSummary;
+
+/*
+ * HELPERS
+ */
+
+/**
+ * @brief  Signed OSCTRIM value of a dump.
+ * @param  p_regs Registers of the dump.
+ * @retval Trim, see MCP7940M_SetTrim.
+ */
+static int DumpTrim(const uint8_t *p_regs)
+{
+    int trim = p_regs[MCP7940M_REG_OSCTRIM] & MCP7940M_OSCTRIM_TRIMVAL;
+
+    return (p_regs[MCP7940M_REG_OSCTRIM] & MCP7940M_OSCTRIM_SIGN) ? trim : -trim;
+}
+
+/**
+ * @brief  Monotonic time in seconds.
+ */
+static double DumpSeconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * DECODING
+ */
+
+/**
+ * @brief  Decodes all dumps of a mapped file.
+ * @note   Dumps are first located in batches of DUMP_BATCH, then their time
+ *         blocks are decoded in one tight pass.
+ * @param  p_data Mapped file.
+ * @param  size File size.
+ * @param  csv 1 to print one line per dump.
+ * @param  p_summary Receives the totals.
+ */
+static void DumpDecode(const uint8_t *p_data, size_t size, int csv, DumpSummary *p_summary)
+{
+    MCP7940M_DumpView views[DUMP_BATCH];
+    MCP7940M_Time times[DUMP_BATCH];
+    uint32_t epoch;
+    size_t offset = 0;
+    uint16_t length;
+    uint32_t count;
+    uint32_t i;
+
+    memset(p_summary, 0, sizeof(*p_summary));
+    p_summary->earliest = UINT32_MAX;
+
+    while (offset < size)
+    {
+        count = 0;
+        while (count < DUMP_BATCH && offset < size)
+        {
+            length = MCP7940M_DumpParse(p_data + offset, (uint32_t)(size - offset), &views[count]);
+            if (length == 0)
+            {
+                p_summary->skipped++;
+                offset++;
+                continue;
+            }
+            offset += length;
+            count++;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            MCP7940M_DecodeTimeBlock(views[i].p_regs, &times[i]);
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            const uint8_t *p_regs = views[i].p_regs;
+            int running = (p_regs[MCP7940M_REG_RTCSEC] & MCP7940M_RTCSEC_ST) && (p_regs[MCP7940M_REG_RTCWKDAY] & MCP7940M_RTCWKDAY_OSCRUN);
+            int valid;
+
+            epoch = MCP7940M_TimeToEpoch(&times[i]);
+            valid = epoch != MCP7940M_EPOCH_INVALID;
+            if (!valid)
+            {
+                p_summary->invalid++;
+            }
+            else
+            {
+                if (p_summary->dumps == p_summary->invalid)
+                {
+                    p_summary->first = epoch; // First valid dump.
+                }
+                p_summary->last = epoch;
+                p_summary->earliest = (epoch < p_summary->earliest) ? epoch : p_summary->earliest;
+                p_summary->latest = (epoch > p_summary->latest) ? epoch : p_summary->latest;
+            }
+            p_summary->stopped += running ? 0 : 1;
+            p_summary->withSram += (views[i].p_sram != NULL) ? 1 : 0;
+
+            if (csv)
+            {
+                printf("%llu,%u,20%02u-%02u-%02u %02u:%02u:%02u,%d,%d,%d,0x%02X,%d\n", (unsigned long long)p_summary->dumps, epoch,
+                       times[i].year, times[i].month, times[i].date, times[i].hours, times[i].minutes, times[i].seconds, valid,
+                       running, DumpTrim(p_regs), p_regs[MCP7940M_REG_CONTROL], views[i].p_sram != NULL);
+            }
+            p_summary->dumps++;
+        }
+    }
+}
+
+/*
+ * GENERATOR
+ */
+
+/**
+ * @brief  Writes simulated dumps, a random walk through time.
+ * @param  p_path Output file.
+ * @param  count Number of dumps.
+ * @retval 0 if success.
+ */
+static int DumpGenerate(const char *p_path, unsigned long count)
+{
+    static MCP7940M_Sim sim;
+    MCP7940M mcp7940m;
+    const MCP7940M_Time start = {0, 0, 12, SATURDAY, 1, 1, 20};
+    uint8_t buffer[MCP7940M_DUMP_MAX_SIZE];
+    uint16_t length;
+    unsigned long i;
+    FILE *p_file;
+
+    MCP7940M_SimInit(&sim, 400000);
+    MCP7940M_SimSetTime(&sim, &start, 1);
+    if (MCP7940M_InitTransport(&mcp7940m, &MCP7940M_Sim_Transport, &sim) != HAL_OK)
+    {
+        return 1;
+    }
+
+    p_file = fopen(p_path, "wb");
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return 1;
+    }
+
+    srand(1);
+    for (i = 0; i < count; i++)
+    {
+        MCP7940M_SimAdvance(&sim, (uint64_t)(rand() % 3600) * 1000000ULL);
+        if (MCP7940M_Dump(&mcp7940m, buffer, (i % DUMP_SRAM_EVERY) == 0, &length) != HAL_OK || fwrite(buffer, 1, length, p_file) != length)
+        {
+            fclose(p_file);
+            return 1;
+        }
+    }
+    return fclose(p_file) == 0 ? 0 : 1;
+}
+
+/*
+ * MAIN
+ */
+int main(int argc, char **argv)
+{
+    DumpSummary summary;
+    struct stat st;
+    const uint8_t *p_data;
+    const char *p_path;
+    double seconds;
+    int csv = 0;
+    int fd;
+
+    if (argc == 4 && strcmp(argv[1], "-g") == 0)
+    {
+        return DumpGenerate(argv[3], strtoul(argv[2], NULL, 10));
+    }
+    if (argc == 3 && strcmp(argv[1], "-c") == 0)
+    {
+        csv = 1;
+    }
+    else if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s [-c] file | -g count file\n", argv[0]);
+        return 2;
+    }
+    p_path = argv[argc - 1];
+
+    fd = open(p_path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(p_path);
+        return 1;
+    }
+    if (st.st_size == 0)
+    {
+        printf("0 dumps\n");
+        close(fd);
+        return 0;
+    }
+    p_data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p_data == MAP_FAILED)
+    {
+        perror("mmap");
+        close(fd);
+        return 1;
+    }
+    posix_madvise((void *)p_data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+
+    if (csv)
+    {
+        printf("index,epoch,time,valid,running,trim,control,sram\n");
+    }
+    seconds = DumpSeconds();
+    DumpDecode(p_data, (size_t)st.st_size, csv, &summary);
+    seconds = DumpSeconds() - seconds;
+
+    if (!csv)
+    {
+        printf("dumps       %llu (%llu with SRAM)\n", (unsigned long long)summary.dumps, (unsigned long long)summary.withSram);
+        printf("invalid     %llu\n", (unsigned long long)summary.invalid);
+        printf("stopped     %llu\n", (unsigned long long)summary.stopped);
+        printf("skipped     %llu bytes\n", (unsigned long long)summary.skipped);
+        if (summary.dumps > summary.invalid)
+        {
+            printf("first/last  %u / %u\n", summary.first, summary.last);
+            printf("range       %u .. %u\n", summary.earliest, summary.latest);
+        }
+        printf("decoded in  %.3f s, %.1f M dumps/s\n", seconds, seconds > 0 ? summary.dumps / seconds * 1e-6 : 0.0);
+    }
+
+    munmap((void *)p_data, (size_t)st.st_size);
+    close(fd);
+    return 0;
+}
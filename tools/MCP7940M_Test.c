@@ -0,0 +1,360 @@
+/*
+ * MCP7940M_Test.c
+ *
+ * Host tests of the MCP7940M driver against the simulated chip of MCP7940M_Sim.c.
+ * Checks the bus cost of the time transfers, the epoch and packed time conversions,
+ * the transaction list merging, the SRAM ring recovery and the weekday mapping.
+ * Prints every failed check and exits with 1 if there was any.
+ *
+ * Build from the repository root:
+ *   cc -std=c99 -O2 -DMCP7940M_NO_HAL -I. tools/MCP7940M_Test.c MCP7940M.c MCP7940M_Sim.c -o mcp7940m_test
+ * Run:
+ *   ./mcp7940m_test
+ *
+ * MIT License
+ *
+ * Copyright (c) 2024 Stian-Lund
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "MCP7940M.h"
+#include "MCP7940M_Sim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * DEFINES
+ */
+#define TEST_CHECK(condition) TestCheck((condition) ? 1 : 0, #condition, __LINE__)
+
+#define TEST_RING_BASE 8   /* SRAM offset of the test ring */
+#define TEST_RING_SLOT 4   /* Tag and three record bytes */
+#define TEST_RING_SLOTS 4
+
+static MCP7940M_Sim testSim;
+static MCP7940M testMcp;
+static unsigned testChecks;
+static unsigned testFailures;
+
+/*
+ * HELPERS
+ */
+static void TestCheck(int passed, const char *p_condition, int line)
+{
+    testChecks++;
+    if (!passed)
+    {
+        testFailures++;
+        printf("FAIL line %d: %s\n", line, p_condition);
+    }
+}
+
+static int TestTimeEqual(const MCP7940M_Time *p_a, const MCP7940M_Time *p_b)
+{
+    return p_a->seconds == p_b->seconds && p_a->minutes == p_b->minutes && p_a->hours == p_b->hours &&
+           p_a->weekday == p_b->weekday && p_a->date == p_b->date && p_a->month == p_b->month && p_a->year == p_b->year;
+}
+
+/**
+ * @brief  Starts the simulated chip at a time and initializes the driver on it.
+ * @param  p_time Time of the chip, running.
+ */
+static void TestSetup(const MCP7940M_Time *p_time)
+{
+    MCP7940M_SimInit(&testSim, 400000);
+    MCP7940M_SimSetTime(&testSim, p_time, 1);
+    TEST_CHECK(MCP7940M_InitTransport(&testMcp, &MCP7940M_Sim_Transport, &testSim) == HAL_OK);
+    MCP7940M_SimResetStats(&testSim);
+}
+
+/*
+ * TESTS
+ */
+
+/**
+ * @brief  Transactions of the time transfers.
+ */
+static void TestTransferCounts(void)
+{
+    const MCP7940M_Time start = {10, 30, 12, WEDNESDAY, 14, 2, 24};
+
+    TestSetup(&start);
+
+    TEST_CHECK(MCP7940M_GetTime(&testMcp) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 1);
+    TEST_CHECK(testMcp.minutes == 30 && testMcp.date == 14 && testMcp.weekday == WEDNESDAY);
+
+    /* Stop with RTCSEC from the shadow, poll OSCRUN, write the time with ST set */
+    MCP7940M_SimResetStats(&testSim);
+    TEST_CHECK(MCP7940M_SetTime(&testMcp) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 3);
+
+    /* One changed field costs one single register write */
+    TEST_CHECK(MCP7940M_GetTime(&testMcp) == HAL_OK);
+    MCP7940M_SimResetStats(&testSim);
+    testMcp.minutes = 45;
+    TEST_CHECK(MCP7940M_StageTime(&testMcp) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 0);
+    TEST_CHECK(MCP7940M_Flush(&testMcp) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 1);
+    TEST_CHECK(testSim.stats.writes == 1);
+    TEST_CHECK(testSim.memory[MCP7940M_REG_RTCMIN] == 0x45);
+    TEST_CHECK(testSim.memory[MCP7940M_REG_RTCSEC] & MCP7940M_RTCSEC_ST);
+
+    /* Nothing left to write */
+    MCP7940M_SimResetStats(&testSim);
+    TEST_CHECK(MCP7940M_Flush(&testMcp) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 0);
+}
+
+/**
+ * @brief  Epoch conversions across leap days, year ends and the range ends.
+ */
+static void TestEpoch(void)
+{
+    static const struct
+    {
+        MCP7940M_Time time;
+        uint32_t epoch;
+    } cases[] = {
+        {{0, 0, 0, SATURDAY, 1, 1, 0}, 946684800UL},
+        {{0, 0, 0, TUESDAY, 29, 2, 0}, 951782400UL},
+        {{59, 59, 23, THURSDAY, 29, 2, 24}, 1709251199UL},
+        {{0, 0, 0, FRIDAY, 1, 3, 24}, 1709251200UL},
+        {{59, 59, 23, SATURDAY, 28, 2, 99}, 4076006399UL},
+        {{59, 59, 23, TUESDAY, 31, 12, 24}, 1735689599UL},
+        {{0, 0, 0, WEDNESDAY, 1, 1, 25}, 1735689600UL},
+        {{59, 59, 23, MONDAY, 31, 12, 63}, 2966371199UL},
+        {{0, 0, 0, TUESDAY, 1, 1, 64}, 2966371200UL},
+        {{59, 59, 23, THURSDAY, 31, 12, 99}, 4102444799UL},
+    };
+    const MCP7940M_Time badMonth = {0, 0, 0, MONDAY, 1, 13, 24};
+    const MCP7940M_Time badDate = {0, 0, 0, MONDAY, 32, 1, 24};
+    MCP7940M_Time time;
+    uint32_t epoch;
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        TEST_CHECK(MCP7940M_TimeToEpoch(&cases[i].time) == cases[i].epoch);
+        MCP7940M_EpochToTime(cases[i].epoch, &time);
+        TEST_CHECK(TestTimeEqual(&time, &cases[i].time));
+    }
+
+    /* The same conversions through the chip */
+    TestSetup(&cases[2].time);
+    TEST_CHECK(MCP7940M_GetEpoch(&testMcp, &epoch) == HAL_OK);
+    TEST_CHECK(epoch == cases[2].epoch);
+    MCP7940M_SimAdvance(&testSim, 1000000ULL);
+    TEST_CHECK(MCP7940M_GetEpoch(&testMcp, &epoch) == HAL_OK);
+    TEST_CHECK(epoch == cases[3].epoch);
+    TEST_CHECK(testMcp.month == 3 && testMcp.date == 1 && testMcp.weekday == FRIDAY);
+
+    TEST_CHECK(MCP7940M_SetEpoch(&testMcp, cases[9].epoch) == HAL_OK);
+    TEST_CHECK(MCP7940M_GetEpoch(&testMcp, &epoch) == HAL_OK);
+    TEST_CHECK(epoch == cases[9].epoch);
+
+    TEST_CHECK(MCP7940M_TimeToEpoch(&badMonth) == MCP7940M_EPOCH_INVALID);
+    TEST_CHECK(MCP7940M_TimeToEpoch(&badDate) == MCP7940M_EPOCH_INVALID);
+}
+
+/**
+ * @brief  Packed times order like their epochs and differ by the same seconds.
+ */
+static void TestPacked(void)
+{
+    static const MCP7940M_Time times[] = {
+        {0, 0, 0, SATURDAY, 1, 1, 0},
+        {59, 59, 23, SUNDAY, 31, 12, 0},
+        {0, 0, 0, THURSDAY, 29, 2, 24},
+        {59, 59, 23, THURSDAY, 29, 2, 24},
+        {0, 0, 0, FRIDAY, 1, 3, 24},
+        {0, 0, 12, MONDAY, 1, 7, 24},
+        {0, 1, 12, MONDAY, 1, 7, 24},
+        {59, 59, 23, MONDAY, 31, 12, 63},
+    };
+    const MCP7940M_Time outOfRange = {0, 0, 0, TUESDAY, 1, 1, 64};
+    MCP7940M_PackedTime packed[sizeof(times) / sizeof(times[0])];
+    MCP7940M_Time time;
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+    {
+        packed[i] = MCP7940M_PackTime(&times[i]);
+        TEST_CHECK(packed[i] != MCP7940M_PACKED_INVALID);
+        MCP7940M_UnpackTime(packed[i], &time);
+        TEST_CHECK(TestTimeEqual(&time, &times[i]));
+    }
+
+    for (i = 0; i < sizeof(times) / sizeof(times[0]); i++)
+    {
+        for (j = 0; j < sizeof(times) / sizeof(times[0]); j++)
+        {
+            int64_t seconds = (int64_t)MCP7940M_TimeToEpoch(&times[i]) - (int64_t)MCP7940M_TimeToEpoch(&times[j]);
+
+            TEST_CHECK(MCP7940M_PackedCompare(packed[i], packed[j]) == (i > j) - (i < j));
+            TEST_CHECK(MCP7940M_PackedDiff(packed[i], packed[j]) == seconds);
+        }
+    }
+
+    TEST_CHECK(MCP7940M_PackTime(&outOfRange) == MCP7940M_PACKED_INVALID);
+}
+
+/**
+ * @brief  Adjacent transfers of a transaction list merge into one burst.
+ */
+static void TestTxn(void)
+{
+    const MCP7940M_Time start = {0, 0, 12, MONDAY, 1, 7, 24};
+    MCP7940M_TxnList list;
+    uint8_t control = 0;
+    uint8_t trim = 0;
+    uint8_t alarm[2] = {0};
+
+    TestSetup(&start);
+
+    /* CONTROL and OSCTRIM are one burst, so are two reads across a short gap */
+    MCP7940M_TxnInit(&list);
+    TEST_CHECK(MCP7940M_TxnQueueWriteRegister(&list, MCP7940M_REG_CONTROL, MCP7940M_CONTROL_SQWEN) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueWriteRegister(&list, MCP7940M_REG_OSCTRIM, 0x85) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_CONTROL, &control, 1) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_OSCTRIM, &trim, 1) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_ALM0SEC, &alarm[0], 1) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_ALM0SEC + MCP7940M_TXN_READ_GAP + 1, &alarm[1], 1) == HAL_OK);
+    TEST_CHECK(list.burstCount == 2);
+
+    TEST_CHECK(MCP7940M_TxnExecute(&testMcp, &list) == HAL_OK);
+    TEST_CHECK(testSim.stats.transactions == 2);
+    TEST_CHECK(testSim.stats.writes == 1);
+    TEST_CHECK(testSim.memory[MCP7940M_REG_CONTROL] == MCP7940M_CONTROL_SQWEN);
+    TEST_CHECK(testSim.memory[MCP7940M_REG_OSCTRIM] == 0x85);
+    TEST_CHECK(control == MCP7940M_CONTROL_SQWEN && trim == 0x85);
+
+    /* A longer gap starts a new burst */
+    MCP7940M_TxnInit(&list);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_ALM0SEC, &alarm[0], 1) == HAL_OK);
+    TEST_CHECK(MCP7940M_TxnQueueRead(&list, MCP7940M_REG_ALM0SEC + MCP7940M_TXN_READ_GAP + 2, &alarm[1], 1) == HAL_OK);
+    TEST_CHECK(list.burstCount == 2);
+}
+
+/**
+ * @brief  A ring recovers its records after an MCU reset, also with an append torn off.
+ * @note   The chip stores every byte as it is received, so a reset during an
+ *         append leaves the slot written up to some byte, the tag first.
+ */
+static void TestRing(void)
+{
+    const MCP7940M_Time start = {0, 0, 12, MONDAY, 1, 7, 24};
+    MCP7940M_SramRing ring;
+    MCP7940M_SramRing mounted;
+    uint8_t record[TEST_RING_SLOT - 1];
+    uint8_t *p_slot;
+    uint8_t i;
+
+    TestSetup(&start);
+    TEST_CHECK(MCP7940M_RingFormat(&testMcp, &ring, TEST_RING_BASE, TEST_RING_SLOT, TEST_RING_SLOTS) == HAL_OK);
+
+    /* Wrap once: records 2..5 remain */
+    for (i = 0; i < TEST_RING_SLOTS + 2; i++)
+    {
+        memset(record, i, sizeof(record));
+        TEST_CHECK(MCP7940M_RingAppend(&testMcp, &ring, record) == HAL_OK);
+    }
+    TEST_CHECK(MCP7940M_RingMount(&testMcp, &mounted, TEST_RING_BASE, TEST_RING_SLOT, TEST_RING_SLOTS) == HAL_OK);
+    TEST_CHECK(mounted.count == TEST_RING_SLOTS && mounted.next == ring.next && mounted.sequence == ring.sequence);
+
+    /* Torn before the tag: the ring mounts as it was */
+    MCP7940M_SetRetries(&testMcp, 0, 0);
+    MCP7940M_SimFail(&testSim, 1, HAL_ERROR);
+    memset(record, 0xEE, sizeof(record));
+    TEST_CHECK(MCP7940M_RingAppend(&testMcp, &ring, record) == HAL_ERROR);
+    TEST_CHECK(MCP7940M_RingMount(&testMcp, &mounted, TEST_RING_BASE, TEST_RING_SLOT, TEST_RING_SLOTS) == HAL_OK);
+    TEST_CHECK(mounted.count == TEST_RING_SLOTS && mounted.next == ring.next && mounted.sequence == ring.sequence);
+    TEST_CHECK(MCP7940M_RingRead(&testMcp, &mounted, 0, record) == HAL_OK);
+    TEST_CHECK(record[0] == 2 && record[2] == 2);
+
+    /* Torn after the tag and one data byte: the slot counts as the newest record */
+    p_slot = &testSim.memory[MCP7940M_REG_SRAM + TEST_RING_BASE + mounted.next * TEST_RING_SLOT];
+    p_slot[0] = mounted.sequence;
+    p_slot[1] = 0xEE;
+    TEST_CHECK(MCP7940M_RingMount(&testMcp, &mounted, TEST_RING_BASE, TEST_RING_SLOT, TEST_RING_SLOTS) == HAL_OK);
+    TEST_CHECK(mounted.count == TEST_RING_SLOTS);
+    TEST_CHECK(mounted.next == (ring.next + 1) % TEST_RING_SLOTS);
+    TEST_CHECK(MCP7940M_RingRead(&testMcp, &mounted, 0, record) == HAL_OK);
+    TEST_CHECK(record[0] == 3);
+    TEST_CHECK(MCP7940M_RingRead(&testMcp, &mounted, TEST_RING_SLOTS - 2, record) == HAL_OK);
+    TEST_CHECK(record[0] == 5);
+
+    /* Appending continues after it */
+    memset(record, 6, sizeof(record));
+    TEST_CHECK(MCP7940M_RingAppend(&testMcp, &mounted, record) == HAL_OK);
+    TEST_CHECK(MCP7940M_RingMount(&testMcp, &ring, TEST_RING_BASE, TEST_RING_SLOT, TEST_RING_SLOTS) == HAL_OK);
+    TEST_CHECK(ring.count == TEST_RING_SLOTS && ring.next == mounted.next && ring.sequence == mounted.sequence);
+    TEST_CHECK(MCP7940M_RingRead(&testMcp, &ring, TEST_RING_SLOTS - 1, record) == HAL_OK);
+    TEST_CHECK(record[0] == 6 && record[2] == 6);
+}
+
+/**
+ * @brief  RTCWKDAY counts 1..7 for MONDAY..SUNDAY.
+ */
+static void TestWeekday(void)
+{
+    const MCP7940M_Time sunday = {59, 59, 23, SUNDAY, 7, 7, 24};
+    uint8_t data;
+
+    TEST_CHECK(MCP7940M_EncodeWeekday(MONDAY) == 1);
+    TEST_CHECK(MCP7940M_EncodeWeekday(SUNDAY) == 7);
+    TEST_CHECK(MCP7940M_DecodeWeekday(1) == MONDAY);
+    TEST_CHECK(MCP7940M_DecodeWeekday(7 | MCP7940M_RTCWKDAY_OSCRUN) == SUNDAY);
+    TEST_CHECK(MCP7940M_DecodeWeekday(0) == MONDAY);
+
+    /* Written as 7, wraps to 1 at midnight */
+    TestSetup(&sunday);
+    TEST_CHECK(MCP7940M_SetTime(&testMcp) == HAL_OK);
+    TEST_CHECK((testSim.memory[MCP7940M_REG_RTCWKDAY] & 0b00000111) == 7);
+    MCP7940M_SimAdvance(&testSim, 1000000ULL);
+    TEST_CHECK((testSim.memory[MCP7940M_REG_RTCWKDAY] & 0b00000111) == 1);
+    TEST_CHECK(MCP7940M_GetTime(&testMcp) == HAL_OK);
+    TEST_CHECK(testMcp.weekday == MONDAY && testMcp.date == 8);
+
+    /* A single register write keeps OSCRUN */
+    testMcp.weekday = FRIDAY;
+    TEST_CHECK(MCP7940M_WriteWeekday(&testMcp) == HAL_OK);
+    TEST_CHECK(MCP7940M_ReadRegister(&testMcp, MCP7940M_REG_RTCWKDAY, &data) == HAL_OK);
+    TEST_CHECK((data & 0b00000111) == 5 && (data & MCP7940M_RTCWKDAY_OSCRUN));
+}
+
+/*
+ * MAIN
+ */
+int main(void)
+{
+    TestTransferCounts();
+    TestEpoch();
+    TestPacked();
+    TestTxn();
+    TestRing();
+    TestWeekday();
+
+    printf("%u checks, %u failed\n", testChecks, testFailures);
+    return (testFailures == 0) ? 0 : 1;
+}